@@ -0,0 +1,41 @@
+#!/bin/sh
+# Compares event affinity, bench/ems_affinity, with the default round-robin scheduling with work stealing,
+# bench/ems_rr. Both are built with a state access delay of 0, so each access to the state is a zero nanosleep of
+# tens of microseconds, and the timings show how well each scheduling overlaps those accesses across threads.
+# A .jobs file is generated with RESERVE and SHOW lines spread over many 16x16 events, then each build runs it
+# at every thread count and reports how long it took, as printed by main.
+# Usage: bench/affinity.sh [lines] [events] [thread counts...], 20000, 128 and 1 2 4 8 by default.
+
+set -e
+lines=${1:-20000}
+events=${2:-128}
+[ $# -gt 2 ] && shift 2 && threads=$* || threads="1 2 4 8"
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# Every event is created first, then each line picks an event at random and reserves its next free seat, one
+# line in 256 shows it instead
+awk -v lines="$lines" -v events="$events" 'BEGIN {
+  srand(1)
+  for (e = 1; e <= events; e++) printf "CREATE %d 16 16\n", e
+  for (i = 0; i < lines; i++) {
+    e = int(rand() * events) + 1
+    if (i % 256 == 255 || taken[e] == 256) printf "SHOW %d\n", e
+    else {
+      printf "RESERVE %d [(%d,%d)]\n", e, int(taken[e] / 16) + 1, taken[e] % 16 + 1
+      taken[e]++
+    }
+  }
+}' > "$dir/bench.jobs"
+
+# Prints the milliseconds a build took to process the jobs directory
+run() {
+  rm -f "$dir/bench.out"
+  "$1" "$dir" 1 "$2" 2>/dev/null | sed -n 's/^Processed .* in \([0-9]*\) ms$/\1/p'
+}
+
+printf "%8s %14s %14s\n" threads "round-robin ms" "affinity ms"
+for t in $threads; do
+  printf "%8s %14s %14s\n" "$t" "$(run ./bench/ems_rr "$t")" "$(run ./bench/ems_affinity "$t")"
+done
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "eventlist.h"
+
+// Compares get_event, indexed by a hash table on the event id, with walking the list from head to tail as
+// get_event did before the table. Usage: registry [number of events...], 10^3, 10^5 and 10^6 by default.
+
+#define HASH_LOOKUPS 1000000        // Lookups timed on the hash table at every size
+#define LIST_VISITS 100000000       // Nodes the list walks may visit at every size, bounding their lookups
+
+/// Generates the next pseudo-random number of a sequence, the same on every run.
+/// @param state State of the sequence, not 0.
+/// @return Next number.
+static unsigned int next_random(unsigned int* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/// Generates the id of the i-th event, multiplying by an odd constant spreads the ids without repeating any.
+/// @param i Index of the event.
+/// @return Id of the event.
+static unsigned int event_id(size_t i) { return (unsigned int)(i + 1) * 2654435761u; }
+
+/// Finds an event walking the list from its head, as get_event did before the hash table.
+/// @param list Event list to be searched.
+/// @param id Event id.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* walk_list(struct EventList* list, unsigned int id) {
+  for (struct ListNode* current = list->head; current != NULL; current = current->next) {
+    if (current->event->id == id) return current->event;
+  }
+  return NULL;
+}
+
+/// Gets the time elapsed since a given time.
+/// @param start Time to measure from.
+/// @return Nanoseconds elapsed.
+static double elapsed_ns(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/// Times both lookups on a list of the given size.
+/// @param num_events Number of events in the list.
+/// @return 0 if the benchmark ran, 1 otherwise.
+static int bench_size(size_t num_events) {
+  struct EventList* list = create_list();
+  if (list == NULL) return 1;
+
+  for (size_t i = 0; i < num_events; i++) {
+    struct Event* event = calloc(1, sizeof(struct Event));
+    if (event != NULL) event->id = event_id(i);
+    if (event == NULL || append_to_list(list, event) != 0) {
+      fprintf(stderr, "Failed to build a list of %zu events\n", num_events);
+      free(event);
+      free_list(list);
+      return 1;
+    }
+  }
+
+  // Every lookup hits, at an event picked at random, so the walks visit half the list on average
+  unsigned int state = 2463534242u;
+  size_t found = 0;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < HASH_LOOKUPS; i++) {
+    found += get_event(list, event_id(next_random(&state) % num_events)) != NULL;
+  }
+  double hash_ns = elapsed_ns(&start) / HASH_LOOKUPS;
+
+  size_t walks = LIST_VISITS / num_events > 100 ? LIST_VISITS / num_events : 100;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < walks; i++) {
+    found += walk_list(list, event_id(next_random(&state) % num_events)) != NULL;
+  }
+  double list_ns = elapsed_ns(&start) / (double)walks;
+
+  if (found != HASH_LOOKUPS + walks) {
+    fprintf(stderr, "Lookups missed events\n");
+    free_list(list);
+    return 1;
+  }
+  printf("%10zu %16.1f %16.1f %10.0fx\n", num_events, hash_ns, list_ns, list_ns / hash_ns);
+  free_list(list);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  size_t default_sizes[] = {1000, 100000, 1000000};
+
+  printf("%10s %16s %16s %11s\n", "events", "hash ns/lookup", "list ns/lookup", "speedup");
+  if (argc < 2) {
+    for (size_t i = 0; i < sizeof(default_sizes) / sizeof(size_t); i++) {
+      if (bench_size(default_sizes[i]) != 0) return 1;
+    }
+    return 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    size_t num_events = strtoul(argv[i], NULL, 10);
+    if (num_events == 0 || bench_size(num_events) != 0) return 1;
+  }
+  return 0;
+}
@@ -1,2 +1,26 @@
 #define MAX_RESERVATION_SIZE 256
-#define STATE_ACCESS_DELAY_MS 10
+#ifndef STATE_ACCESS_DELAY_MS
+#define STATE_ACCESS_DELAY_MS 10  // Delay before every access to the state, 0 in the benchmarks
+#endif
+#define STRIPE_ROWS 16                  // Rows covered by each lock stripe of a striped event
+#define STRIPE_MIN_SEATS 65536          // Events at least this large are striped when created
+#define STRIPE_CONTENTION_THRESHOLD 32  // Contended writes after which an event becomes striped
+#define SHOW_OPTIMISTIC_RETRIES 2      // Failed lock-free copies of a seat map before SHOW locks the event
+#define READER_BUFFER_SIZE 8192         // Bytes the parser reads from a .jobs file at a time
+#define OUTPUT_BUFFER_INITIAL_SIZE 4096  // Bytes a worker's output buffer starts with, doubled when full
+#define OUTPUT_IOV_BATCH 1024           // Most pieces of output handed to a single writev
+
+// Routes CREATE, RESERVE and SHOW to a worker by event id so each worker owns its events, built with AFFINITY=1
+#ifndef EVENT_AFFINITY
+#define EVENT_AFFINITY 0
+#endif
+
+// Keeps the events in memory shared by every process forked from main, built with SHARED=1
+#ifndef EMS_SHARED
+#define EMS_SHARED 0
+#endif
+#define SHARED_STATE_SIZE ((size_t)1 << 30)  // Bytes reserved for the shared state, only used pages take memory
+
+#if EVENT_AFFINITY && EMS_SHARED
+#error "Event affinity keeps events private to each worker, it cannot be combined with the shared state"
+#endif
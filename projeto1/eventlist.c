@@ -2,9 +2,46 @@
 
 #include <stdlib.h>
 
+#define INITIAL_BUCKETS 64
+
+/// Hashes an event id into a bucket index.
+/// @param event_id Event id.
+/// @param num_buckets Number of buckets, must be a power of two.
+/// @return Index of the bucket.
+static size_t bucket_index(unsigned int event_id, size_t num_buckets) {
+  return (size_t)(event_id * 2654435761u) & (num_buckets - 1);
+}
+
+/// Doubles the number of buckets and rehashes every node.
+/// @param list Event list to be resized.
+/// @return 0 if the list was resized successfully, 1 otherwise.
+static int grow_buckets(struct EventList* list) {
+  size_t num_buckets = list->num_buckets * 2;
+  struct ListNode** buckets = (struct ListNode**)calloc(num_buckets, sizeof(struct ListNode*));
+  if (!buckets) return 1;
+
+  for (struct ListNode* current = list->head; current; current = current->next) {
+    size_t index = bucket_index(current->event->id, num_buckets);
+    current->bucket_next = buckets[index];
+    buckets[index] = current;
+  }
+
+  free(list->buckets);
+  list->buckets = buckets;
+  list->num_buckets = num_buckets;
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
+  list->buckets = (struct ListNode**)calloc(INITIAL_BUCKETS, sizeof(struct ListNode*));
+  if (!list->buckets) {
+    free(list);
+    return NULL;
+  }
+  list->num_buckets = INITIAL_BUCKETS;
+  list->size = 0;
   list->head = NULL;
   list->tail = NULL;
   return list;
@@ -13,6 +50,9 @@ struct EventList* create_list() {
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
+  // Keep the load factor at or below 1 so chains stay short
+  if (list->size + 1 > list->num_buckets && grow_buckets(list) != 0) return 1;
+
   struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
   if (!new_node) return 1;
 
@@ -27,12 +67,21 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  size_t index = bucket_index(event->id, list->num_buckets);
+  new_node->bucket_next = list->buckets[index];
+  list->buckets[index] = new_node;
+  list->size++;
+
   return 0;
 }
 
 static void free_event(struct Event* event) {
   if (!event) return;
 
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    pthread_rwlock_destroy(&event->stripes[i]);
+  }
+  free(event->stripes);
   free(event->data);
   free(event);
 }
@@ -49,19 +98,20 @@ void free_list(struct EventList* list) {
     free(temp);
   }
 
+  free(list->buckets);
   free(list);
 }
 
 struct Event* get_event(struct EventList* list, unsigned int event_id) {
   if (!list) return NULL;
 
-  struct ListNode* current = list->head;
+  struct ListNode* current = list->buckets[bucket_index(event_id, list->num_buckets)];
   while (current) {
     struct Event* event = current->event;
     if (event->id == event_id) {
       return event;
     }
-    current = current->next;
+    current = current->bucket_next;
   }
 
   return NULL;
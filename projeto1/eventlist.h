@@ -1,29 +1,44 @@
 #ifndef EVENT_LIST_H
 #define EVENT_LIST_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <pthread.h>
 
 struct Event {
   unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  atomic_uint reservations;   /// Number of reservations for the event.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
+  atomic_uint* data;  /// Array of size rows * cols with the reservations for each seat.
   pthread_rwlock_t event_lock;
+
+  atomic_int striped;         /// Whether reservations lock stripes of rows instead of the whole event.
+  atomic_uint contention;     /// Number of times a writer found the event lock taken.
+  pthread_rwlock_t* stripes;  /// One lock per STRIPE_ROWS rows, NULL until the event is striped.
+  size_t num_stripes;         /// Number of stripes.
+
+  atomic_uint writes_started;  /// Number of reservations that started writing to data.
+  atomic_uint writes_done;     /// Number of reservations that finished writing to data.
+
+  size_t created;  /// Order in which the event was created, to list events kept in several lists.
 };
 
 struct ListNode {
   struct Event* event;
   struct ListNode* next;
+  struct ListNode* bucket_next;  // Next node in the same hash bucket
 };
 
-// Linked list structure
+// Linked list structure, indexed by a hash table on the event id
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
+  struct ListNode* head;      // Head of the list
+  struct ListNode* tail;      // Tail of the list
+  struct ListNode** buckets;  // Hash buckets, chained through bucket_next
+  size_t num_buckets;         // Number of buckets, always a power of two
+  size_t size;                // Number of events in the list
   pthread_rwlock_t list_lock;
 };
 
@@ -0,0 +1,187 @@
+#include "jobFile.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Makes room for one more command, doubling the array when full.
+/// @param job Job file being compiled.
+/// @param capacity Pointer to the number of commands the array has room for.
+/// @return 0 if successful, 1 on error.
+static int grow_commands(struct JobFile *job, size_t *capacity) {
+  if (job->num_lines < *capacity) {
+    return 0;
+  }
+
+  struct JobCommand *commands = realloc(job->commands, 2 * *capacity * sizeof(struct JobCommand));
+  if (commands == NULL) {
+    return 1;
+  }
+  job->commands = commands;
+  *capacity *= 2;
+  return 0;
+}
+
+/// Appends the seats of a RESERVE to the shared coordinate arrays, doubling them when needed.
+/// @param job Job file being compiled.
+/// @param num_coords Pointer to the number of seats stored so far.
+/// @param capacity Pointer to the number of seats the arrays have room for.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+/// @param count Number of seats.
+/// @return 0 if successful, 1 on error.
+static int add_coords(struct JobFile *job, size_t *num_coords, size_t *capacity, const size_t *xs, const size_t *ys,
+                      size_t count) {
+  while (*num_coords + count > *capacity) {
+    size_t *new_xs = realloc(job->xs, 2 * *capacity * sizeof(size_t));
+    if (new_xs == NULL) {
+      return 1;
+    }
+    job->xs = new_xs;
+
+    size_t *new_ys = realloc(job->ys, 2 * *capacity * sizeof(size_t));
+    if (new_ys == NULL) {
+      return 1;
+    }
+    job->ys = new_ys;
+    *capacity *= 2;
+  }
+
+  memcpy(job->xs + *num_coords, xs, count * sizeof(size_t));
+  memcpy(job->ys + *num_coords, ys, count * sizeof(size_t));
+  *num_coords += count;
+  return 0;
+}
+
+int job_file_open(struct JobFile *job, const char *path) {
+  job->commands = NULL;
+  job->num_lines = 0;
+  job->xs = NULL;
+  job->ys = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open input file %s\n", path);
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fprintf(stderr, "Failed to stat input file %s\n", path);
+    close(fd);
+    return 1;
+  }
+  size_t size = (size_t)st.st_size;
+
+  // mmap refuses empty mappings, an empty file simply has no lines
+  const char *data = NULL;
+  if (size > 0) {
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      fprintf(stderr, "Failed to map input file %s\n", path);
+      close(fd);
+      return 1;
+    }
+    posix_madvise(mapped, size, POSIX_MADV_SEQUENTIAL);
+    data = mapped;
+  }
+  close(fd);
+
+  size_t capacity = 64, coord_capacity = 64, num_coords = 0;
+  job->commands = malloc(capacity * sizeof(struct JobCommand));
+  job->xs = malloc(coord_capacity * sizeof(size_t));
+  job->ys = malloc(coord_capacity * sizeof(size_t));
+  int failed = job->commands == NULL || job->xs == NULL || job->ys == NULL;
+
+  // A line ends after its newline, the last one may have none
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  struct Reader reader;
+  size_t offset = 0;
+  while (!failed && offset < size) {
+    const char *newline = memchr(data + offset, '\n', size - offset);
+    size_t end = newline != NULL ? (size_t)(newline - data) + 1 : size;
+    reader_init_memory(&reader, data + offset, end - offset);
+    offset = end;
+
+    if (grow_commands(job, &capacity) != 0) {
+      failed = 1;
+      break;
+    }
+    struct JobCommand *command = &job->commands[job->num_lines++];
+    memset(command, 0, sizeof(*command));
+    command->type = get_next(&reader);
+
+    switch (command->type) {
+      case CMD_CREATE:
+        if (parse_create(&reader, &command->event_id, &command->num_rows, &command->num_cols) != 0) {
+          command->type = CMD_INVALID;
+        }
+        break;
+
+      case CMD_RESERVE:
+        command->num_coords = parse_reserve(&reader, MAX_RESERVATION_SIZE, &command->event_id, xs, ys);
+        if (command->num_coords == 0) {
+          command->type = CMD_INVALID;
+          break;
+        }
+        command->first_coord = num_coords;
+        failed = add_coords(job, &num_coords, &coord_capacity, xs, ys, command->num_coords);
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(&reader, &command->event_id) != 0) {
+          command->type = CMD_INVALID;
+        }
+        break;
+
+      case CMD_WAIT:
+        switch (parse_wait(&reader, &command->delay, &command->thread_id)) {
+          case 0:
+            command->thread_id = 0;
+            break;
+          case 1:
+            // Threads are numbered from 1, a WAIT for thread 0 would otherwise wait on all of them
+            if (command->thread_id == 0) {
+              command->type = CMD_EMPTY;
+            }
+            break;
+          default:
+            command->type = CMD_EMPTY;
+            break;
+        }
+        break;
+
+      case CMD_LIST_EVENTS:
+      case CMD_BARRIER:
+      case CMD_HELP:
+      case CMD_EMPTY:
+      case CMD_INVALID:
+      case EOC:
+        break;
+    }
+  }
+
+  if (data != NULL) {
+    munmap((void *)data, size);
+  }
+  if (failed) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    job_file_close(job);
+    return 1;
+  }
+  return 0;
+}
+
+void job_file_close(struct JobFile *job) {
+  free(job->commands);
+  free(job->xs);
+  free(job->ys);
+  job->commands = NULL;
+  job->xs = NULL;
+  job->ys = NULL;
+  job->num_lines = 0;
+}
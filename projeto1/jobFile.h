@@ -0,0 +1,40 @@
+#ifndef JOB_FILE_H
+#define JOB_FILE_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+/// One line of a .jobs file, already parsed.
+/// Lines whose arguments fail to parse are stored as CMD_INVALID, malformed WAITs as CMD_EMPTY.
+struct JobCommand {
+  enum Command type;       // Command of the line
+  unsigned int event_id;   // CREATE, RESERVE and SHOW
+  size_t num_rows;         // CREATE
+  size_t num_cols;         // CREATE
+  size_t num_coords;       // RESERVE, number of seats
+  size_t first_coord;      // RESERVE, index of the first seat in xs and ys
+  unsigned int delay;      // WAIT, in milliseconds
+  unsigned int thread_id;  // WAIT, thread that waits, 0 for every thread
+};
+
+/// A .jobs file compiled once into an array of commands, one per line, that every thread reads
+/// without parsing anything. It is never modified after job_file_open returns.
+struct JobFile {
+  struct JobCommand *commands;  // Commands of each line, in order
+  size_t num_lines;             // Number of lines
+  size_t *xs;                   // Rows of the seats of every RESERVE, sorted per command
+  size_t *ys;                   // Columns of the seats of every RESERVE, sorted per command
+};
+
+/// Maps a .jobs file and compiles each of its lines in a single pass.
+/// @param job Job file to initialize.
+/// @param path Path to the file.
+/// @return 0 if successful, 1 on error.
+int job_file_open(struct JobFile *job, const char *path);
+
+/// Frees the commands of a job file.
+/// @param job Job file to close.
+void job_file_close(struct JobFile *job);
+
+#endif  // JOB_FILE_H
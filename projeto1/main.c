@@ -18,6 +18,109 @@
 
 #include <linux/limits.h>
 #include <sys/stat.h>
+#include <time.h>
+
+/// A .jobs file of the directory being processed.
+struct JobEntry {
+  char name[NAME_MAX + 1];  // Name of the file inside the directory
+  off_t size;               // Size of the file, the estimate of how long it takes
+  pid_t pid;                // Process running it, 0 until it is started
+  struct timespec start;    // When its process was started
+};
+
+/// Orders job files from the largest to the smallest.
+/// @param a First job file.
+/// @param b Second job file.
+/// @return Negative if a is larger, positive if b is larger, 0 if they have the same size.
+static int compare_job_size(const void *a, const void *b) {
+  const struct JobEntry *job_a = a;
+  const struct JobEntry *job_b = b;
+  return (job_a->size < job_b->size) - (job_a->size > job_b->size);
+}
+
+/// Gets the milliseconds elapsed since a point in time.
+/// @param since Time measured with CLOCK_MONOTONIC.
+/// @return Elapsed milliseconds.
+static long elapsed_ms(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+/// Collects every .jobs file of a directory, sorted from the largest to the smallest.
+/// @param dir Open directory.
+/// @param jobs_directory Path to the directory.
+/// @param jobs Pointer to the array to store the files in, to be freed by the caller.
+/// @param num_jobs Pointer to the variable to store the number of files in.
+/// @return 0 if successful, 1 on error.
+static int scan_jobs(DIR *dir, const char *jobs_directory, struct JobEntry **jobs, size_t *num_jobs) {
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (!check_file_extension(entry->d_name)) {
+      continue;
+    }
+
+    if (*num_jobs == capacity) {
+      capacity = capacity == 0 ? 16 : 2 * capacity;
+      struct JobEntry *grown = realloc(*jobs, capacity * sizeof(struct JobEntry));
+      if (grown == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(*jobs);
+        *jobs = NULL;
+        return 1;
+      }
+      *jobs = grown;
+    }
+
+    char job_path[PATH_MAX];
+    struct stat st;
+    snprintf(job_path, sizeof(job_path), "%s/%s", jobs_directory, entry->d_name);
+    struct JobEntry *job = &(*jobs)[(*num_jobs)++];
+    strcpy(job->name, entry->d_name);
+    job->size = stat(job_path, &st) == 0 ? st.st_size : 0;
+    job->pid = 0;
+  }
+
+  qsort(*jobs, *num_jobs, sizeof(struct JobEntry), compare_job_size);
+  return 0;
+}
+
+/// Waits for any job process to finish and reports it with its wall time.
+/// @param jobs Job files being processed.
+/// @param num_jobs Number of job files.
+/// @return 0 if a process finished or there is none left to wait for, 1 if the wait was interrupted.
+static int wait_job(struct JobEntry *jobs, size_t num_jobs) {
+  int status;
+  pid_t terminated_pid = wait(&status);
+  if (terminated_pid == -1) {
+    if (errno == EINTR) {
+      return 1;
+    }
+    fprintf(stderr, "Wait error.\n");
+    return 0;
+  }
+
+  struct JobEntry *job = NULL;
+  for (size_t i = 0; i < num_jobs && job == NULL; i++) {
+    if (jobs[i].pid == terminated_pid) {
+      job = &jobs[i];
+    }
+  }
+  const char *name = job != NULL ? job->name : "?";
+  long ms = job != NULL ? elapsed_ms(&job->start) : 0;
+
+  if (WIFEXITED(status)) {
+      printf("Process %d (%s) terminated with status %d after %ld ms\n", terminated_pid, name,
+            WEXITSTATUS(status), ms);
+  } else if (WIFSIGNALED(status)) {
+      printf("Process %d (%s) terminated by signal %d after %ld ms\n", terminated_pid, name,
+            WTERMSIG(status), ms);
+  } else {
+      printf("Process %d (%s) terminated abnormally after %ld ms\n", terminated_pid, name, ms);
+  }
+  return 0;
+}
 
 
 int main(int argc, char *argv[]) {
@@ -44,69 +147,52 @@ int main(int argc, char *argv[]) {
   }
 
 
-  //creates a process for each file
-  struct dirent *entry;
-  int status;
+  // Every .jobs file is known before the first fork, so the largest ones can start first
+  struct JobEntry *jobs = NULL;
+  size_t num_jobs = 0;
+  if (scan_jobs(dir, jobs_directory, &jobs, &num_jobs)) {
+    closedir(dir);
+    ems_terminate();
+    return 1;
+  }
+
+  //creates a process for each file, largest first
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
   int process_counter = 0;
-  pid_t terminated_pid;
-  while ((entry = readdir(dir)) != NULL) {
-      if (check_file_extension(entry->d_name)) {
-          while (process_counter >= MAX_PROC) {
-              terminated_pid = wait(&status);
-              if (terminated_pid == -1) {
-                  fprintf(stderr, "Wait error.\n");
-              } else {
-                  if (WIFEXITED(status)) {
-                      printf("Process %d terminated with status %d\n", terminated_pid, 
-                            WEXITSTATUS(status));
-                  } else if (WIFSIGNALED(status)) {
-                      printf("Process %d terminated by signal %d\n", terminated_pid, 
-                            WTERMSIG(status));
-                  } else {
-                      printf("Process %d terminated abnormally\n", terminated_pid);
-                  }
-                  process_counter--;
-              }
-          }
-          pid_t pid = fork();
-          if (pid == -1) {
-              fprintf(stderr, "Fork did not succeed\n");
-          } else if (pid == 0) {
-              char job_path[PATH_MAX];
-              sprintf(job_path, "%s/%s", jobs_directory, entry->d_name);
-              process_file(job_path, MAX_THREADS);
-              if (closedir(dir) == -1) {
-                fprintf(stderr, "Failed to close directory.FIXME\n");
-                ems_terminate();
-                return 1;
-              }
-              ems_terminate();
-              exit(0);
-          } else {
-              process_counter++;
+  for (size_t i = 0; i < num_jobs; i++) {
+      while (process_counter >= MAX_PROC) {
+          if (wait_job(jobs, num_jobs) == 0) {
+              process_counter--;
           }
       }
+      // Anything still buffered would otherwise be printed again by the child
+      fflush(stdout);
+      clock_gettime(CLOCK_MONOTONIC, &jobs[i].start);
+      pid_t pid = fork();
+      if (pid == -1) {
+          fprintf(stderr, "Fork did not succeed\n");
+      } else if (pid == 0) {
+          char job_path[PATH_MAX];
+          snprintf(job_path, sizeof(job_path), "%s/%s", jobs_directory, jobs[i].name);
+          process_file(job_path, MAX_THREADS);
+          free(jobs);
+          closedir(dir);
+          ems_terminate();
+          exit(0);
+      } else {
+          jobs[i].pid = pid;
+          process_counter++;
+      }
   }
 
   while (process_counter > 0) {
-    terminated_pid = wait(&status);
-
-    if (terminated_pid == -1) {
-        fprintf(stderr, "Wait error.\n");
-    } else {
-        if (WIFEXITED(status)) {
-            printf("Process %d terminated with status %d\n", terminated_pid, 
-                  WEXITSTATUS(status));
-        } else if (WIFSIGNALED(status)) {
-            printf("Process %d terminated by signal %d\n", terminated_pid, 
-                  WTERMSIG(status));
-        } else {
-            printf("Process %d terminated abnormally\n", terminated_pid);
-        }
-
-        process_counter--;
+    if (wait_job(jobs, num_jobs) == 0) {
+      process_counter--;
     }
   }
+  printf("Processed %zu files in %ld ms\n", num_jobs, elapsed_ms(&start));
+  free(jobs);
 
   if (argc > 4) {
     char *endptr;
@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "errno.h"
@@ -6,14 +7,19 @@
 #include <unistd.h>
 #include <pthread.h>
 
+#include "constants.h"
 #include "threadFn.h"
 #include "processFile.h"
 #include "threadFn.h"
 #include "eventlist.h"
 #include "operations.h"
+#include "outputBuffer.h"
+#include "sharedState.h"
 
 static struct EventList* event_list = NULL;
+static struct SharedState* shared_state = NULL;  // State shared by every process in shared mode, see EMS_SHARED
 static unsigned int state_access_delay_ms = 0;
+static atomic_size_t events_created = 0;  // Events created so far, gives each event its place in LIST
 
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
@@ -24,13 +30,14 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
 
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @param list List to search, the shared event_list or one owned by a worker.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id) {
+static struct Event* get_event_with_delay(struct EventList* list, unsigned int event_id) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id);
+  return get_event(list, event_id);
 }
 
 /// Gets the seat with the given index from the state.
@@ -38,7 +45,7 @@ static struct Event* get_event_with_delay(unsigned int event_id) {
 /// @param event Event to get the seat from.
 /// @param index Index of the seat to get.
 /// @return Pointer to the seat.
-static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
+static atomic_uint* get_seat_with_delay(struct Event* event, size_t index) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
@@ -53,12 +60,400 @@ static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
+/// Checks whether an event has enough rows for striping to pay off.
+/// @param event Event to check.
+/// @return 1 if the event should be striped, 0 otherwise.
+static int stripes_worthwhile(struct Event* event) { return event->rows >= 2 * STRIPE_ROWS; }
+
+/// Splits the rows of an event into lock stripes.
+/// @note The caller must hold the event lock for writing or be the only one with access to the event.
+/// @param event Event to be striped.
+/// @return 0 if the stripes were created successfully, 1 otherwise.
+static int enable_stripes(struct Event* event) {
+  size_t num_stripes = (event->rows + STRIPE_ROWS - 1) / STRIPE_ROWS;
+  pthread_rwlock_t* stripes = malloc(num_stripes * sizeof(pthread_rwlock_t));
+  if (stripes == NULL) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_stripes; i++) {
+    if (pthread_rwlock_init(&stripes[i], NULL) != 0) {
+      for (size_t j = 0; j < i; j++) {
+        pthread_rwlock_destroy(&stripes[j]);
+      }
+      free(stripes);
+      return 1;
+    }
+  }
+
+  event->stripes = stripes;
+  event->num_stripes = num_stripes;
+  atomic_store(&event->striped, 1);
+  return 0;
+}
+
+/// Checks whether the rows of a reservation are in ascending order.
+/// @param num_seats Number of seats in the reservation.
+/// @param xs Array of rows of the seats.
+/// @return 1 if the rows are sorted, 0 otherwise.
+static int rows_sorted(size_t num_seats, size_t* xs) {
+  for (size_t i = 1; i < num_seats; i++) {
+    if (xs[i] < xs[i - 1]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/// Locks for writing the stripes covering the given rows.
+/// @note The rows must be sorted, so the stripes are always taken in ascending order and never deadlock.
+/// @param event Striped event.
+/// @param num_seats Number of seats in the reservation.
+/// @param xs Array of rows of the seats.
+static void lock_stripes(struct Event* event, size_t num_seats, size_t* xs) {
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t stripe = (xs[i] - 1) / STRIPE_ROWS;
+    if (i == 0 || stripe != (xs[i - 1] - 1) / STRIPE_ROWS) {
+      pthread_rwlock_wrlock(&event->stripes[stripe]);
+    }
+  }
+}
+
+/// Unlocks the stripes locked with lock_stripes.
+/// @param event Striped event.
+/// @param num_seats Number of seats in the reservation.
+/// @param xs Array of rows of the seats.
+static void unlock_stripes(struct Event* event, size_t num_seats, size_t* xs) {
+  for (size_t i = num_seats; i > 0; i--) {
+    size_t stripe = (xs[i - 1] - 1) / STRIPE_ROWS;
+    if (i == 1 || stripe != (xs[i - 2] - 1) / STRIPE_ROWS) {
+      pthread_rwlock_unlock(&event->stripes[stripe]);
+    }
+  }
+}
+
+/// Allocates an event with every seat free.
+/// @param event_id Id of the event.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return Newly created event, NULL on failure.
+static struct Event* new_event(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct Event* event = malloc(sizeof(struct Event));
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    return NULL;
+  }
+
+  if (pthread_rwlock_init(&event->event_lock, NULL) != 0) {
+    fprintf(stderr, "Failed to initialize lock\n");
+    free(event);
+    return NULL;
+  }
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  atomic_init(&event->striped, 0);
+  atomic_init(&event->contention, 0);
+  atomic_init(&event->writes_started, 0);
+  atomic_init(&event->writes_done, 0);
+  event->stripes = NULL;
+  event->num_stripes = 0;
+  event->created = atomic_fetch_add(&events_created, 1);
+  event->data = malloc(num_rows * num_cols * sizeof(atomic_uint));
+
+  if (event->data == NULL) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    pthread_rwlock_destroy(&event->event_lock);
+    free(event);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < num_rows * num_cols; i++) {
+    atomic_init(&event->data[i], 0);
+  }
+  return event;
+}
+
+/// Checks that every seat of a reservation exists.
+/// @param event Event to reserve in.
+/// @param num_seats Number of seats in the reservation.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @return 1 if every seat exists, 0 otherwise.
+static int seats_valid(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/// Reserves seats that nobody else can be writing to, either because the caller holds the locks covering them
+/// or because it owns the event.
+/// @param event Event to reserve in.
+/// @param num_seats Number of seats in the reservation.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @return 0 if the seats were reserved, 1 if one of them was already taken or repeated.
+static int reserve_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  size_t i = 0;
+  for (; i < num_seats; i++) {
+    size_t j = 0;
+    while (j < i && (xs[j] != xs[i] || ys[j] != ys[i])) {
+      j++;
+    }
+
+    if (j < i || atomic_load_explicit(get_seat_with_delay(event, seat_index(event, xs[i], ys[i])),
+                                      memory_order_relaxed) != 0) {
+      fprintf(stderr, "Seat already reserved\n");
+      return 1;
+    }
+  }
+
+  // The id is only taken once the reservation is known to succeed, as striped reservations run concurrently
+  unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+
+  // Optimistic readers retry if writes_started moved while they copied data, see copy_seats
+  atomic_fetch_add_explicit(&event->writes_started, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  for (size_t j = 0; j < num_seats; j++) {
+    atomic_store_explicit(get_seat_with_delay(event, seat_index(event, xs[j], ys[j])), reservation_id,
+                          memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&event->writes_done, 1, memory_order_release);
+  return 0;
+}
+
+/// Appends a copy of the seat map of an event to the output of the line being run.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @param seats Array of size rows * cols with the reservation of each seat.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+static int print_seats(size_t rows, size_t cols, unsigned int* seats, struct OutputBuffer* out) {
+  if (output_append_seats(out, seats, rows, cols) != 0) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Appends one line of LIST to the output of the line being run.
+/// @param event_id Id of the event listed.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the line was written successfully, 1 otherwise.
+static int print_event_id(unsigned int event_id, struct OutputBuffer* out) {
+  if (output_append(out, "Event: ", strlen("Event: ")) != 0 || output_append_uint(out, event_id) != 0 ||
+      output_append(out, "\n", 1) != 0) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Gets the event with the given ID from the shared state.
+/// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct SharedEvent* shared_get_event_with_delay(unsigned int event_id) {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  nanosleep(&delay, NULL);  // Should not be removed
+
+  return shared_get_event(shared_state, event_id);
+}
+
+/// Gets the seat with the given index from the shared state.
+/// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @param event Event to get the seat from.
+/// @param index Index of the seat to get.
+/// @return Pointer to the seat.
+static atomic_uint* shared_seat_with_delay(struct SharedEvent* event, size_t index) {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  nanosleep(&delay, NULL);  // Should not be removed
+
+  return (atomic_uint*)shared_at(shared_state, event->data) + index;
+}
+
+/// Creates an event in the shared state.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @return 0 if the event was created successfully, 1 otherwise.
+static int shared_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (pthread_rwlock_wrlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    return 1;
+  }
+
+  int failed = 1;
+  if (shared_get_event_with_delay(event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+  } else {
+    size_t offset = shared_new_event(shared_state, event_id, num_rows, num_cols);
+    if (offset == 0) {
+      fprintf(stderr, "Shared state is full\n");
+    } else {
+      shared_append_event(shared_state, offset);
+      failed = 0;
+    }
+  }
+
+  if (pthread_rwlock_unlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
+  }
+  return failed;
+}
+
+/// Creates a reservation for an event in the shared state.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int shared_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  // Events are never moved nor freed, so the event stays valid once the list lock is released
+  if (pthread_rwlock_rdlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    return 1;
+  }
+  struct SharedEvent* event = shared_get_event_with_delay(event_id);
+  if (pthread_rwlock_unlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
+  }
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      return 1;
+    }
+  }
+
+  if (pthread_rwlock_wrlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    return 1;
+  }
+
+  size_t i = 0;
+  for (; i < num_seats; i++) {
+    size_t j = 0;
+    while (j < i && (xs[j] != xs[i] || ys[j] != ys[i])) {
+      j++;
+    }
+
+    if (j < i || atomic_load(shared_seat_with_delay(event, (xs[i] - 1) * event->cols + ys[i] - 1)) != 0) {
+      fprintf(stderr, "Seat already reserved\n");
+      break;
+    }
+  }
+
+  if (i == num_seats) {
+    unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+    for (size_t j = 0; j < num_seats; j++) {
+      atomic_store(shared_seat_with_delay(event, (xs[j] - 1) * event->cols + ys[j] - 1), reservation_id);
+    }
+  }
+
+  if (pthread_rwlock_unlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
+  }
+  return i < num_seats;
+}
+
+/// Prints an event of the shared state.
+/// @param event_id Id of the event to print.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int shared_show(unsigned int event_id, struct OutputBuffer* out) {
+  if (pthread_rwlock_rdlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    return 1;
+  }
+  struct SharedEvent* event = shared_get_event_with_delay(event_id);
+  if (pthread_rwlock_unlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
+  }
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  unsigned int* seats = malloc(event->rows * event->cols * sizeof(unsigned int));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    free(seats);
+    return 1;
+  }
+  for (size_t i = 0; i < event->rows * event->cols; i++) {
+    seats[i] = atomic_load(shared_seat_with_delay(event, i));
+  }
+  if (pthread_rwlock_unlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    free(seats);
+    return 1;
+  }
+
+  int failed = print_seats(event->rows, event->cols, seats, out);
+  free(seats);
+  return failed;
+}
+
+/// Prints every event of the shared state, including those created by other processes.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+static int shared_list_events(struct OutputBuffer* out) {
+  if (pthread_rwlock_rdlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
+    return 1;
+  }
+
+  int failed = 0;
+  if (shared_state->num_events == 0) {
+    failed = output_append(out, "No events\n", strlen("No events\n"));
+  }
+  for (size_t offset = shared_state->head; offset != 0 && !failed;) {
+    struct SharedEvent* event = shared_at(shared_state, offset);
+    failed = print_event_id(event->id, out);
+    offset = event->next;
+  }
+
+  if (pthread_rwlock_unlock(&shared_state->list_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
+  }
+  return failed;
+}
+
 int ems_init(unsigned int delay_ms) {
-  if (event_list != NULL) {
+  if (event_list != NULL || shared_state != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
     return 1;
   }
 
+  if (EMS_SHARED) {
+    shared_state = shared_state_create(SHARED_STATE_SIZE);
+    state_access_delay_ms = delay_ms;
+    return shared_state == NULL;
+  }
+
   event_list = create_list();
   state_access_delay_ms = delay_ms;
   if (pthread_rwlock_init(&event_list->list_lock, NULL) != 0) {
@@ -70,6 +465,12 @@ int ems_init(unsigned int delay_ms) {
 }
 
 int ems_terminate() {
+  if (shared_state != NULL) {
+    shared_state_destroy(shared_state);
+    shared_state = NULL;
+    return 0;
+  }
+
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -80,6 +481,10 @@ int ems_terminate() {
 }
 
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (shared_state != NULL) {
+    return shared_create(event_id, num_rows, num_cols);
+  }
+
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -91,7 +496,7 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  if (get_event_with_delay(event_id) != NULL) {
+  if (get_event_with_delay(event_list, event_id) != NULL) {
     fprintf(stderr, "Event already exists\n");
     return 1;
   }
@@ -107,38 +512,23 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
-
-  if (pthread_rwlock_init(&event->event_lock, NULL) != 0) {
-    fprintf(stderr, "Failed to initialize lock\n");
-    return 1;
-  }
-
+  struct Event* event = new_event(event_id, num_rows, num_cols);
   if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
     pthread_rwlock_unlock(&event_list->list_lock);
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  event->data = malloc(num_rows * num_cols * sizeof(unsigned int));
-
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    free(event);
-    pthread_rwlock_unlock(&event_list->list_lock);
-    return 1;
-  }
-
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i] = 0;
+  // Large events are striped before anyone can see them, smaller ones once they get contended
+  if (num_rows * num_cols >= STRIPE_MIN_SEATS && stripes_worthwhile(event) && enable_stripes(event) != 0) {
+    fprintf(stderr, "Error allocating memory for event stripes\n");
   }
 
   if (append_to_list(event_list, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
+    for (size_t i = 0; i < event->num_stripes; i++) {
+      pthread_rwlock_destroy(&event->stripes[i]);
+    }
+    free(event->stripes);
     free(event->data);
     free(event);
     pthread_rwlock_unlock(&event_list->list_lock);
@@ -152,6 +542,10 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (shared_state != NULL) {
+    return shared_reserve(event_id, num_seats, xs, ys);
+  }
+
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -162,7 +556,7 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     pthread_rwlock_unlock(&event_list->list_lock);
     return 1;
   }
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = get_event_with_delay(event_list, event_id);
   if (pthread_rwlock_unlock(&event_list->list_lock) != 0) {
     fprintf(stderr, "Failed to unlock\n");
     return 1;
@@ -173,45 +567,94 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event->event_lock) != 0) {
-    fprintf(stderr, "Failed to lock\n");
-    pthread_rwlock_unlock(&event->event_lock);
+  if (!seats_valid(event, num_seats, xs, ys)) {
     return 1;
   }
 
-  unsigned int reservation_id = ++event->reservations;
-
-  size_t i = 0;
-  for (; i < num_seats; i++) {
-    size_t row = xs[i];
-    size_t col = ys[i];
-
-    if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
-      fprintf(stderr, "Invalid seat\n");
-      break;
+  // A striped event shares its lock between reservations, which only exclude each other on their stripes
+  int striped = atomic_load(&event->striped) && rows_sorted(num_seats, xs);
+  if (striped) {
+    if (pthread_rwlock_rdlock(&event->event_lock) != 0) {
+      fprintf(stderr, "Failed to lock\n");
+      return 1;
+    }
+    lock_stripes(event, num_seats, xs);
+  } else {
+    int ret = pthread_rwlock_trywrlock(&event->event_lock);
+    if (ret == EBUSY) {
+      atomic_fetch_add_explicit(&event->contention, 1, memory_order_relaxed);
+      ret = pthread_rwlock_wrlock(&event->event_lock);
+    }
+    if (ret != 0) {
+      fprintf(stderr, "Failed to lock\n");
+      return 1;
     }
 
-    if (*get_seat_with_delay(event, seat_index(event, row, col)) != 0) {
-      fprintf(stderr, "Seat already reserved\n");
-      break;
+    // A hot event switches to striped locking, which takes effect from the next reservation on
+    if (!atomic_load(&event->striped) && stripes_worthwhile(event) &&
+        atomic_load(&event->contention) >= STRIPE_CONTENTION_THRESHOLD) {
+      enable_stripes(event);
     }
+  }
+
+  int failed = reserve_seats(event, num_seats, xs, ys);
 
-    *get_seat_with_delay(event, seat_index(event, row, col)) = reservation_id;
+  if (striped) {
+    unlock_stripes(event, num_seats, xs);
+  }
+  if (pthread_rwlock_unlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to unlock\n");
+    return 1;
   }
+  return failed;
+}
 
-  //If the reservation was not successful, free the seats that were reserved.
-  if (i < num_seats) {
-    event->reservations--;
-    for (size_t j = 0; j < i; j++) {
-      *get_seat_with_delay(event, seat_index(event, xs[j], ys[j])) = 0;
+/// Copies the seat map of an event without blocking reservations.
+/// @note Striped reservations write concurrently, so a copy is consistent when no write was in flight before
+/// it and none started during it. After SHOW_OPTIMISTIC_RETRIES inconsistent copies the event is locked for reading.
+/// @param event Event to copy the seats from.
+/// @param seats Array of size rows * cols to copy the seats to.
+/// @return 0 if the seats were copied successfully, 1 otherwise.
+static int copy_seats(struct Event* event, unsigned int* seats) {
+  for (int attempt = 0; attempt < SHOW_OPTIMISTIC_RETRIES; attempt++) {
+    unsigned int done = atomic_load_explicit(&event->writes_done, memory_order_acquire);
+    unsigned int started = atomic_load_explicit(&event->writes_started, memory_order_relaxed);
+    if (started != done) {
+      continue;
     }
-    if (pthread_rwlock_unlock(&event->event_lock) != 0) {
-      fprintf(stderr, "Failed to unlock\n");
-      return 1;
+
+    for (size_t i = 0; i < event->rows * event->cols; i++) {
+      seats[i] = atomic_load_explicit(get_seat_with_delay(event, i), memory_order_relaxed);
     }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&event->writes_started, memory_order_relaxed) == started) {
+      return 0;
+    }
+  }
+
+  if (pthread_rwlock_rdlock(&event->event_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
     return 1;
   }
 
+  // The striped flag only changes with the event lock held for writing, so it is stable from here
+  int striped = atomic_load(&event->striped);
+  if (striped) {
+    for (size_t i = 0; i < event->num_stripes; i++) {
+      pthread_rwlock_rdlock(&event->stripes[i]);
+    }
+  }
+
+  for (size_t i = 0; i < event->rows * event->cols; i++) {
+    seats[i] = atomic_load_explicit(get_seat_with_delay(event, i), memory_order_relaxed);
+  }
+
+  if (striped) {
+    for (size_t i = event->num_stripes; i > 0; i--) {
+      pthread_rwlock_unlock(&event->stripes[i - 1]);
+    }
+  }
   if (pthread_rwlock_unlock(&event->event_lock) != 0) {
     fprintf(stderr, "Failed to unlock\n");
     return 1;
@@ -219,7 +662,11 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
   return 0;
 }
 
-int ems_show(unsigned int event_id, int output_fd, pthread_mutex_t *lock) {
+int ems_show(unsigned int event_id, struct OutputBuffer* out) {
+  if (shared_state != NULL) {
+    return shared_show(event_id, out);
+  }
+
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -230,7 +677,7 @@ int ems_show(unsigned int event_id, int output_fd, pthread_mutex_t *lock) {
     pthread_rwlock_unlock(&event_list->list_lock);
     return 1;
   }
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = get_event_with_delay(event_list, event_id);
 
   if (pthread_rwlock_unlock(&event_list->list_lock) != 0) {
     fprintf(stderr, "Failed to unlock\n");
@@ -242,87 +689,137 @@ int ems_show(unsigned int event_id, int output_fd, pthread_mutex_t *lock) {
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event->event_lock) != 0) {
-    fprintf(stderr, "Failed to lock\n");
-    pthread_rwlock_unlock(&event->event_lock);
+  // The seats are copied first, so the event is not locked while they are formatted
+  unsigned int* seats = malloc(event->rows * event->cols * sizeof(unsigned int));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(lock) != 0) {
-    fprintf(stderr, "Failed to lock\n");
-    pthread_mutex_unlock(lock);
-    return 1;
-  }
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      unsigned int* seat = get_seat_with_delay(event, seat_index(event, i, j));
-      char* to_write = (char*) malloc(sizeof(char)*BUFSIZ);
-      sprintf(to_write, "%u", *seat);
-      write_file(output_fd, to_write);
-      free(to_write);
-      if (j < event->cols) {
-        write_file(output_fd, " ");
-      }
-    }
+  if (copy_seats(event, seats) != 0) {
+    free(seats);
+    return 1;
+  }
 
-    write_file(output_fd, "\n");
+  int failed = print_seats(event->rows, event->cols, seats, out);
+  free(seats);
+  return failed;
+}
+
+int ems_list_events(struct OutputBuffer* out) {
+  if (shared_state != NULL) {
+    return shared_list_events(out);
   }
 
-  if (pthread_rwlock_unlock(&event->event_lock) != 0) {
-    fprintf(stderr, "Failed to unlock\n");
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->list_lock) != 0) {
+    fprintf(stderr, "Failed to lock\n");
     return 1;
   }
-  if (pthread_mutex_unlock(lock) != 0) {
+
+  int failed = 0;
+  if (event_list->head == NULL) {
+    failed = output_append(out, "No events\n", strlen("No events\n"));
+  }
+  for (struct ListNode* current = event_list->head; current != NULL && !failed; current = current->next) {
+    failed = print_event_id(current->event->id, out);
+  }
+
+  if (pthread_rwlock_unlock(&event_list->list_lock) != 0) {
     fprintf(stderr, "Failed to unlock\n");
     return 1;
   }
-  return 0;
+  return failed;
 }
 
-int ems_list_events(int output_fd, pthread_mutex_t *lock) {
-
-  if (pthread_rwlock_rdlock(&event_list->list_lock) != 0) {
-    fprintf(stderr, "Failed to lock\n");
-    pthread_rwlock_unlock(&event_list->list_lock);
+int ems_create_owned(struct EventList* events, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (get_event_with_delay(events, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
     return 1;
   }
 
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
-    pthread_rwlock_unlock(&event_list->list_lock);
+  // Only the owner ever touches the event, so it is never striped
+  struct Event* event = new_event(event_id, num_rows, num_cols);
+  if (event == NULL) {
     return 1;
   }
 
-  if (event_list->head == NULL) {
-    write_file(output_fd, "No events\n");
-    pthread_rwlock_unlock(&event_list->list_lock);
-    return 0;
+  if (append_to_list(events, event) != 0) {
+    fprintf(stderr, "Error appending event to list\n");
+    pthread_rwlock_destroy(&event->event_lock);
+    free(event->data);
+    free(event);
+    return 1;
   }
-  
-  if (pthread_mutex_lock(lock) != 0) {
-    fprintf(stderr, "Failed to lock\n");
-    pthread_mutex_unlock(lock);
+  return 0;
+}
+
+int ems_reserve_owned(struct EventList* events, unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  struct Event* event = get_event_with_delay(events, event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  struct ListNode* current = event_list->head;
-  while (current != NULL) {
-    write_file(output_fd, "Event: ");
-    char* to_write = (char*) malloc(sizeof(char)*BUFSIZ);
-    sprintf(to_write, "%u\n",(current->event)->id);
-    write_file(output_fd, to_write);
-    free(to_write);
-    current = current->next;
+  if (!seats_valid(event, num_seats, xs, ys)) {
+    return 1;
   }
+  return reserve_seats(event, num_seats, xs, ys);
+}
 
-  if (pthread_rwlock_unlock(&event_list->list_lock) != 0) {
-    fprintf(stderr, "Failed to unlock\n");
+int ems_show_owned(struct EventList* events, unsigned int event_id, struct OutputBuffer* out) {
+  struct Event* event = get_event_with_delay(events, event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
-  if (pthread_mutex_unlock(lock) != 0) {
-    fprintf(stderr, "Failed to unlock\n");
+
+  unsigned int* seats = malloc(event->rows * event->cols * sizeof(unsigned int));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
     return 1;
   }
+
+  // Nobody else writes to the event, a plain copy is always consistent
+  for (size_t i = 0; i < event->rows * event->cols; i++) {
+    seats[i] = atomic_load_explicit(get_seat_with_delay(event, i), memory_order_relaxed);
+  }
+
+  int failed = print_seats(event->rows, event->cols, seats, out);
+  free(seats);
+  return failed;
+}
+
+int ems_list_owned_events(struct EventList** lists, size_t num_lists, struct OutputBuffer* out) {
+  struct ListNode* heads[num_lists];
+  size_t num_events = 0;
+  for (size_t i = 0; i < num_lists; i++) {
+    heads[i] = lists[i]->head;
+    num_events += lists[i]->size;
+  }
+
+  if (num_events == 0) {
+    return output_append(out, "No events\n", strlen("No events\n"));
+  }
+
+  // Each list is in creation order already, merging them gives the order of a single shared list
+  for (size_t n = 0; n < num_events; n++) {
+    size_t next = num_lists;
+    for (size_t i = 0; i < num_lists; i++) {
+      if (heads[i] != NULL && (next == num_lists || heads[i]->event->created < heads[next]->event->created)) {
+        next = i;
+      }
+    }
+
+    if (print_event_id(heads[next]->event->id, out) != 0) {
+      return 1;
+    }
+    heads[next] = heads[next]->next;
+  }
   return 0;
 }
 
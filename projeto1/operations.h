@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 
+struct EventList;
+struct OutputBuffer;
+
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
@@ -28,12 +31,47 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys)
 
 /// Prints the given event.
 /// @param event_id Id of the event to print.
+/// @param out Output buffer of the calling worker.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(unsigned int event_id, int output_fd, pthread_mutex_t *lock);
+int ems_show(unsigned int event_id, struct OutputBuffer *out);
 
 /// Prints all the events.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+int ems_list_events(struct OutputBuffer *out);
+
+/// Creates a new event in a list owned by the calling worker, without taking any lock.
+/// @note Only for event affinity mode, where every command on an event runs on the worker that owns it.
+/// @param events List of the events owned by the worker.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @return 0 if the event was created successfully, 1 otherwise.
+int ems_create_owned(struct EventList* events, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Creates a new reservation for an event owned by the calling worker, without taking any lock.
+/// @param events List of the events owned by the worker.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_owned(struct EventList* events, unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+
+/// Prints an event owned by the calling worker, without taking any lock.
+/// @param events List of the events owned by the worker.
+/// @param event_id Id of the event to print.
+/// @param out Output buffer of the calling worker.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+int ems_show_owned(struct EventList* events, unsigned int event_id, struct OutputBuffer *out);
+
+/// Prints the events of every worker in the order they were created.
+/// @note Must only be called while no worker runs commands, such as at a barrier.
+/// @param lists Lists of the events owned by each worker.
+/// @param num_lists Number of lists.
+/// @param out Output buffer of the calling worker.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int output_fd, pthread_mutex_t *lock);
+int ems_list_owned_events(struct EventList** lists, size_t num_lists, struct OutputBuffer *out);
 
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
@@ -0,0 +1,226 @@
+#include "outputBuffer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "constants.h"
+
+void output_init(struct OutputBuffer *out) {
+  out->data = NULL;
+  out->size = 0;
+  out->capacity = 0;
+  out->records = NULL;
+  out->num_records = 0;
+  out->records_capacity = 0;
+}
+
+void output_destroy(struct OutputBuffer *out) {
+  free(out->data);
+  free(out->records);
+  output_init(out);
+}
+
+/// Makes room for more bytes, doubling the buffer until they fit.
+/// @param out Buffer to grow.
+/// @param len Bytes that must fit after the current size.
+/// @return 0 if successful, 1 on error.
+static int reserve_bytes(struct OutputBuffer *out, size_t len) {
+  if (len <= out->capacity - out->size) {
+    return 0;
+  }
+
+  size_t capacity = out->capacity > 0 ? out->capacity : OUTPUT_BUFFER_INITIAL_SIZE;
+  while (capacity - out->size < len) {
+    capacity *= 2;
+  }
+  char *data = realloc(out->data, capacity);
+  if (data == NULL) {
+    return 1;
+  }
+  out->data = data;
+  out->capacity = capacity;
+  return 0;
+}
+
+int output_append(struct OutputBuffer *out, const char *str, size_t len) {
+  if (reserve_bytes(out, len) != 0) {
+    return 1;
+  }
+  memcpy(out->data + out->size, str, len);
+  out->size += len;
+  return 0;
+}
+
+/// Two digits for every number below 100, so integers are formatted with one division per pair of digits.
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Formats an unsigned integer in decimal, two digits at a time and without sprintf.
+/// @param buf Buffer with room for UINT_TEXT_MAX characters, no terminator is added.
+/// @param value Value to format.
+/// @return Number of characters written.
+static size_t format_uint(char *buf, unsigned int value) {
+  size_t len = 1;
+  for (unsigned int rest = value; rest >= 10; rest /= 10) {
+    len++;
+  }
+
+  // Digits are placed from the last one, a pair at a time
+  char *end = buf + len;
+  while (value >= 100) {
+    unsigned int pair = value % 100;
+    value /= 100;
+    *--end = digit_pairs[2 * pair + 1];
+    *--end = digit_pairs[2 * pair];
+  }
+  if (value >= 10) {
+    *--end = digit_pairs[2 * value + 1];
+    *--end = digit_pairs[2 * value];
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return len;
+}
+
+int output_append_uint(struct OutputBuffer *out, unsigned int value) {
+  if (reserve_bytes(out, UINT_TEXT_MAX) != 0) {
+    return 1;
+  }
+  out->size += format_uint(out->data + out->size, value);
+  return 0;
+}
+
+int output_append_seats(struct OutputBuffer *out, const unsigned int *seats, size_t rows, size_t cols) {
+  // Room for the longest text every seat can take, so the whole map is formatted in one pass
+  if (cols > 0 && rows > SIZE_MAX / cols / (UINT_TEXT_MAX + 1)) {
+    return 1;
+  }
+  if (reserve_bytes(out, rows * cols * (UINT_TEXT_MAX + 1)) != 0) {
+    return 1;
+  }
+
+  char *text = out->data + out->size;
+  for (size_t i = 0; i < rows; i++) {
+    const unsigned int *row = seats + i * cols;
+    for (size_t j = 0; j < cols; j++) {
+      text += format_uint(text, row[j]);
+      *text++ = j + 1 < cols ? ' ' : '\n';
+    }
+  }
+  out->size = (size_t)(text - out->data);
+  return 0;
+}
+
+int output_record(struct OutputBuffer *out, size_t line, size_t start) {
+  if (out->num_records == out->records_capacity) {
+    size_t capacity = out->records_capacity > 0 ? 2 * out->records_capacity : 64;
+    struct OutputRecord *records = realloc(out->records, capacity * sizeof(struct OutputRecord));
+    if (records == NULL) {
+      return 1;
+    }
+    out->records = records;
+    out->records_capacity = capacity;
+  }
+
+  out->records[out->num_records++] = (struct OutputRecord){line, start, out->size - start};
+  return 0;
+}
+
+/// Output of a line located in the buffer that holds it, ready to be sorted.
+struct Piece {
+  size_t line;       // Line that produced the output (0-based)
+  const char *data;  // First byte of the output
+  size_t length;     // Bytes of output
+};
+
+/// Orders pieces by the line that produced them.
+static int compare_pieces(const void *a, const void *b) {
+  const struct Piece *piece_a = a;
+  const struct Piece *piece_b = b;
+  return (piece_a->line > piece_b->line) - (piece_a->line < piece_b->line);
+}
+
+/// Writes every byte of a vector of buffers, resuming after partial writes.
+/// @param fd File descriptor to write to.
+/// @param iov Buffers to write, modified as they are written.
+/// @param count Number of buffers.
+/// @return 0 if successful, 1 on error.
+static int write_all(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      fprintf(stderr, "write error\n");
+      return 1;
+    }
+
+    size_t left = (size_t)written;
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+  return 0;
+}
+
+int output_flush(struct OutputBuffer *buffers, size_t num_buffers, int fd) {
+  size_t num_records = 0;
+  for (size_t i = 0; i < num_buffers; i++) {
+    num_records += buffers[i].num_records;
+  }
+  if (num_records == 0) {
+    return 0;
+  }
+
+  struct Piece *pieces = malloc(num_records * sizeof(struct Piece));
+  if (pieces == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return 1;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < num_buffers; i++) {
+    for (size_t j = 0; j < buffers[i].num_records; j++) {
+      const struct OutputRecord *record = &buffers[i].records[j];
+      pieces[n++] = (struct Piece){record->line, buffers[i].data + record->start, record->length};
+    }
+  }
+  qsort(pieces, num_records, sizeof(struct Piece), compare_pieces);
+
+  // Consecutive lines run by the same worker usually sit next to each other and share one entry
+  struct iovec iov[OUTPUT_IOV_BATCH];
+  int count = 0, failed = 0;
+  for (size_t r = 0; r < num_records && !failed; r++) {
+    char *data = (char *)pieces[r].data;
+    if (pieces[r].length == 0) {
+      continue;
+    }
+    if (count > 0 && (char *)iov[count - 1].iov_base + iov[count - 1].iov_len == data) {
+      iov[count - 1].iov_len += pieces[r].length;
+      continue;
+    }
+    if (count == OUTPUT_IOV_BATCH) {
+      failed = write_all(fd, iov, count);
+      count = 0;
+    }
+    iov[count++] = (struct iovec){data, pieces[r].length};
+  }
+  if (!failed && count > 0) {
+    failed = write_all(fd, iov, count);
+  }
+
+  free(pieces);
+  for (size_t i = 0; i < num_buffers; i++) {
+    buffers[i].size = 0;
+    buffers[i].num_records = 0;
+  }
+  return failed;
+}
@@ -0,0 +1,72 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <stddef.h>
+
+#define UINT_TEXT_MAX 10  // Digits of the largest unsigned int
+
+/// Output of one line, kept in the buffer of the worker that ran it.
+struct OutputRecord {
+  size_t line;    // Line that produced the output (0-based)
+  size_t start;   // Offset of the output in the buffer
+  size_t length;  // Bytes of output
+};
+
+/// Output of the lines a worker ran since the last flush. Nothing is written to the .out file until
+/// the buffers of every worker are flushed together, in the order of the lines that produced them.
+struct OutputBuffer {
+  char *data;                    // Output of every record, one after the other
+  size_t size;                   // Bytes used
+  size_t capacity;               // Bytes allocated, doubled when full
+  struct OutputRecord *records;  // One per line with output, in the order the lines ran
+  size_t num_records;            // Number of records
+  size_t records_capacity;       // Records allocated, doubled when full
+};
+
+/// Initializes an empty buffer.
+/// @param out Buffer to initialize.
+void output_init(struct OutputBuffer *out);
+
+/// Frees a buffer, dropping anything not flushed.
+/// @param out Buffer to destroy.
+void output_destroy(struct OutputBuffer *out);
+
+/// Appends bytes to the buffer.
+/// @param out Buffer to append to.
+/// @param str Bytes to append.
+/// @param len Number of bytes.
+/// @return 0 if successful, 1 on error.
+int output_append(struct OutputBuffer *out, const char *str, size_t len);
+
+/// Appends an unsigned integer in decimal to the buffer.
+/// @param out Buffer to append to.
+/// @param value Value to append.
+/// @return 0 if successful, 1 on error.
+int output_append_uint(struct OutputBuffer *out, unsigned int value);
+
+/// Appends seats as text, a line per row with the seats separated by spaces.
+/// @note The buffer grows once for the whole map, which is then formatted in a single pass without sprintf.
+/// @param out Buffer to append to.
+/// @param seats Array of size rows * cols with the seats, row by row.
+/// @param rows Number of rows.
+/// @param cols Number of columns.
+/// @return 0 if successful, 1 on error.
+int output_append_seats(struct OutputBuffer *out, const unsigned int *seats, size_t rows, size_t cols);
+
+/// Records everything appended since start as the output of a line.
+/// @param out Buffer the output was appended to.
+/// @param line Line that produced the output (0-based).
+/// @param start Size of the buffer before the line ran.
+/// @return 0 if successful, 1 on error.
+int output_record(struct OutputBuffer *out, size_t line, size_t start);
+
+/// Writes the records of every buffer to a file in line order, with as few writev calls as possible,
+/// and empties the buffers.
+/// @note No worker may append to the buffers meanwhile, such as at a barrier.
+/// @param buffers Buffers to flush.
+/// @param num_buffers Number of buffers.
+/// @param fd File descriptor to write to.
+/// @return 0 if successful, 1 on error.
+int output_flush(struct OutputBuffer *buffers, size_t num_buffers, int fd);
+
+#endif  // OUTPUT_BUFFER_H
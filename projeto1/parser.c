@@ -1,4 +1,5 @@
 #include "parser.h"
+#include <errno.h>
 #include <stdio.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -10,28 +11,92 @@
 
 
 
-static int read_uint(int fd, unsigned int *value, char *next) {
-  char buf[16] = {0};
+void reader_init(struct Reader *reader, int fd) {
+  reader->fd = fd;
+  reader->data = reader->buffer;
+  reader->start = 0;
+  reader->end = 0;
+}
+
+void reader_init_memory(struct Reader *reader, const char *data, size_t size) {
+  reader->fd = -1;
+  reader->data = data;
+  reader->start = 0;
+  reader->end = size;
+}
+
+/// Refills the buffer of a reader that has handed out all its characters.
+/// @param reader Reader to refill.
+/// @return 1 if characters were read, 0 at the end of the file, -1 on error.
+static int reader_fill(struct Reader *reader) {
+  if (reader->fd == -1) {
+    return 0;
+  }
+
+  ssize_t read_bytes;
+  do {
+    read_bytes = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+  } while (read_bytes == -1 && errno == EINTR);
+
+  if (read_bytes <= 0) {
+    return read_bytes == 0 ? 0 : -1;
+  }
+
+  reader->data = reader->buffer;
+  reader->start = 0;
+  reader->end = (size_t)read_bytes;
+  return 1;
+}
+
+int reader_getc(struct Reader *reader, char *ch) {
+  if (reader->start == reader->end) {
+    int ret = reader_fill(reader);
+    if (ret != 1) {
+      return ret;
+    }
+  }
+
+  *ch = reader->data[reader->start++];
+  return 1;
+}
+
+size_t reader_read(struct Reader *reader, char *buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    if (reader->start == reader->end && reader_fill(reader) != 1) {
+      break;
+    }
+
+    size_t available = reader->end - reader->start;
+    size_t chunk = count - done < available ? count - done : available;
+    memcpy(buf + done, reader->data + reader->start, chunk);
+    reader->start += chunk;
+    done += chunk;
+  }
+
+  return done;
+}
+
+static int read_uint(struct Reader *reader, unsigned int *value, char *next) {
+  unsigned long ul = 0;
 
-  int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (reader_getc(reader, next) != 1) {
       *next = '\0';
       break;
     }
 
-    *next = buf[i];
-
-    if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
+    if (*next > '9' || *next < '0') {
       break;
     }
 
-    i++;
+    // Saturate just above UINT_MAX, so overly long numbers are still consumed and rejected
+    ul = ul * 10 + (unsigned long)(*next - '0');
+    if (ul > UINT_MAX) {
+      ul = (unsigned long)UINT_MAX + 1;
+    }
   }
 
-  unsigned long ul = strtoul(buf, NULL, 10);
-
   if (ul > UINT_MAX) {
     return 1;
   }
@@ -41,9 +106,9 @@ static int read_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-static void cleanup(int fd) {
+static void cleanup(struct Reader *reader) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (reader_getc(reader, &ch) == 1 && ch != '\n')
     ;
 }
 
@@ -63,109 +128,109 @@ int compare_coordinates(const void* a, const void* b) {
 
 
 
-enum Command get_next(int fd) {
+enum Command get_next(struct Reader *reader) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (reader_getc(reader, buf) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_CREATE;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_SHOW;
 
     case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (reader_getc(reader, buf + 4) != 0 && buf[4] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_LIST_EVENTS;
 
     case 'B':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
-        cleanup(fd);
+      if (reader_getc(reader, buf + 7) != 0 && buf[7] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_BARRIER;
 
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-        cleanup(fd);
+      if (reader_read(reader, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (reader_getc(reader, buf + 4) != 0 && buf[4] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_HELP;
 
     case '#':
-      cleanup(fd);
+      cleanup(reader);
       return CMD_EMPTY;
 
     case '\n':
       return CMD_EMPTY;
 
     default:
-      cleanup(fd);
+      cleanup(reader);
       printf("X:%c\n", buf[0]);
       return CMD_INVALID;
   }
 }
 
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
+int parse_create(struct Reader *reader, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
 
   unsigned int u_num_rows;
-  if (read_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_rows, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
   *num_rows = (size_t)u_num_rows;
 
   unsigned int u_num_cols;
-  if (read_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
   *num_cols = (size_t)u_num_cols;
@@ -173,43 +238,43 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+size_t parse_reserve(struct Reader *reader, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
   char ch;
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (reader_getc(reader, &ch) != 1 || ch != '[') {
+    cleanup(reader);
     return 0;
   }
 
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
+    if (reader_getc(reader, &ch) != 1 || ch != '(') {
+      cleanup(reader);
       return 0;
     }
 
     unsigned int x;
-    if (read_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
+    if (read_uint(reader, &x, &ch) != 0 || ch != ',') {
+      cleanup(reader);
       return 0;
     }
     xs[num_coords] = (size_t)x;
 
     unsigned int y;
-    if (read_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
+    if (read_uint(reader, &y, &ch) != 0 || ch != ')') {
+      cleanup(reader);
       return 0;
     }
     ys[num_coords] = (size_t)y;
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
+    if (reader_getc(reader, &ch) != 1 || (ch != ' ' && ch != ']')) {
+      cleanup(reader);
       return 0;
     }
 
@@ -219,19 +284,19 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
   }
 
   if (num_coords == max) {
-    cleanup(fd);
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (reader_getc(reader, &ch) != 1 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 0;
   }
   //Sorts the coordinates of the reserve in ascending order
   //To prevent interlock
   Coordinate* coordinates = malloc(num_coords * sizeof(Coordinate));
   if (coordinates == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
   }
 
@@ -252,33 +317,33 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
   return num_coords;
 }
 
-int parse_show(int fd, unsigned int *event_id) {
+int parse_show(struct Reader *reader, unsigned int *event_id) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
 
   return 0;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(struct Reader *reader, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (read_uint(reader, delay, &ch) != 0) {
+    cleanup(reader);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(reader);
       return -1;
     }
 
@@ -286,7 +351,7 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
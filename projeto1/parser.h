@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <pthread.h>
 
+#include "constants.h"
+
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
@@ -23,40 +25,75 @@ typedef struct {
     size_t y;
 } Coordinate;
 
+/// Buffered reader over a file descriptor, so the parser can take one character at a time
+/// without a read syscall for each of them.
+/// It can also read straight from memory, such as a single line of a mapped file.
+struct Reader {
+  int fd;                           // File descriptor to read from, -1 when reading from memory
+  const char *data;                 // Characters being handed out, buffer unless reading from memory
+  size_t start;                     // Index of the next character to hand out
+  size_t end;                       // Number of characters in data
+  char buffer[READER_BUFFER_SIZE];  // Characters read ahead from fd
+};
+
+/// Initializes a reader with an empty buffer.
+/// @param reader Reader to initialize.
+/// @param fd File descriptor to read from.
+void reader_init(struct Reader *reader, int fd);
+
+/// Initializes a reader over characters already in memory, which reaches the end of the file after them.
+/// @param reader Reader to initialize.
+/// @param data Characters to read.
+/// @param size Number of characters.
+void reader_init_memory(struct Reader *reader, const char *data, size_t size);
+
+/// Reads the next character.
+/// @param reader Reader to read from.
+/// @param ch Pointer to the variable to store the character in.
+/// @return 1 if a character was read, 0 at the end of the file, -1 on error.
+int reader_getc(struct Reader *reader, char *ch);
+
+/// Reads up to count characters, stopping early only at the end of the file or on error.
+/// @param reader Reader to read from.
+/// @param buf Buffer to store the characters in.
+/// @param count Number of characters to read.
+/// @return Number of characters read.
+size_t reader_read(struct Reader *reader, char *buf, size_t count);
+
 int compare_coordinates(const void* a, const void* b);
 /// Reads a line and returns the corresponding command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(struct Reader *reader);
 
 /// Parses a CREATE command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param num_rows Pointer to the variable to store the number of rows in.
 /// @param num_cols Pointer to the variable to store the number of columns in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
+int parse_create(struct Reader *reader, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
 
 /// Parses a RESERVE command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param max Maximum number of coordinates to read.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param xs Pointer to the array to store the X coordinates in.
 /// @param ys Pointer to the array to store the Y coordinates in.
 /// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
+size_t parse_reserve(struct Reader *reader, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
 
 /// Parses a SHOW command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_show(int fd, unsigned int *event_id);
+int parse_show(struct Reader *reader, unsigned int *event_id);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(struct Reader *reader, unsigned int *delay, unsigned int *thread_id);
 
 #endif  // EMS_PARSER_H
@@ -0,0 +1,141 @@
+#include "sharedState.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Keeps every allocation as aligned as anything malloc returns
+#define SHARED_ALIGN _Alignof(max_align_t)
+
+/// Hashes an event id into a bucket index.
+/// @param event_id Event id.
+/// @return Index of the bucket.
+static size_t bucket_index(unsigned int event_id) { return (size_t)(event_id * 2654435761u) & (SHARED_BUCKETS - 1); }
+
+/// Initializes a lock that every process mapping the region can use.
+/// @param lock Lock inside the region.
+/// @return 0 if successful, 1 on error.
+static int init_shared_lock(pthread_rwlock_t* lock) {
+  pthread_rwlockattr_t attr;
+  if (pthread_rwlockattr_init(&attr) != 0) {
+    return 1;
+  }
+  int ret = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 || pthread_rwlock_init(lock, &attr) != 0;
+  pthread_rwlockattr_destroy(&attr);
+  return ret;
+}
+
+struct SharedState* shared_state_create(size_t size) {
+  if (size < sizeof(struct SharedState)) {
+    return NULL;
+  }
+
+  // The object is unlinked as soon as it is mapped, the mapping lives until the last process unmaps it
+  char name[64];
+  snprintf(name, sizeof(name), "/ems-state-%ld", (long)getpid());
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to create shared state\n");
+    return NULL;
+  }
+  shm_unlink(name);
+
+  // A truncated object reads as zeros and only takes memory for the pages that are touched
+  void* region = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) {
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (region == MAP_FAILED) {
+    fprintf(stderr, "Failed to map shared state\n");
+    return NULL;
+  }
+
+  struct SharedState* state = region;
+  if (init_shared_lock(&state->list_lock) != 0) {
+    fprintf(stderr, "Failed to initialize list lock\n");
+    munmap(region, size);
+    return NULL;
+  }
+  state->size = size;
+  state->used = (sizeof(struct SharedState) + SHARED_ALIGN - 1) & ~(SHARED_ALIGN - 1);
+  return state;
+}
+
+void shared_state_destroy(struct SharedState* state) {
+  if (state == NULL) return;
+  munmap(state, state->size);
+}
+
+void* shared_at(struct SharedState* state, size_t offset) { return (char*)state + offset; }
+
+size_t shared_alloc(struct SharedState* state, size_t size) {
+  size_t rounded = (size + SHARED_ALIGN - 1) & ~(SHARED_ALIGN - 1);
+  if (rounded < size || rounded > state->size - state->used) {
+    return 0;
+  }
+
+  size_t offset = state->used;
+  state->used += rounded;
+  return offset;
+}
+
+size_t shared_new_event(struct SharedState* state, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (num_cols != 0 && num_rows > SIZE_MAX / num_cols / sizeof(atomic_uint)) {
+    return 0;
+  }
+
+  size_t offset = shared_alloc(state, sizeof(struct SharedEvent));
+  if (offset == 0) {
+    return 0;
+  }
+  // The seats come straight from the mapping, so they are already 0
+  size_t data = shared_alloc(state, num_rows * num_cols * sizeof(atomic_uint));
+  if (data == 0) {
+    return 0;
+  }
+
+  struct SharedEvent* event = shared_at(state, offset);
+  if (init_shared_lock(&event->event_lock) != 0) {
+    return 0;
+  }
+  event->id = event_id;
+  atomic_init(&event->reservations, 0);
+  event->rows = num_rows;
+  event->cols = num_cols;
+  event->data = data;
+  event->next = 0;
+  event->bucket_next = 0;
+  return offset;
+}
+
+void shared_append_event(struct SharedState* state, size_t offset) {
+  struct SharedEvent* event = shared_at(state, offset);
+
+  if (state->head == 0) {
+    state->head = offset;
+  } else {
+    ((struct SharedEvent*)shared_at(state, state->tail))->next = offset;
+  }
+  state->tail = offset;
+
+  size_t index = bucket_index(event->id);
+  event->bucket_next = state->buckets[index];
+  state->buckets[index] = offset;
+  state->num_events++;
+}
+
+struct SharedEvent* shared_get_event(struct SharedState* state, unsigned int event_id) {
+  size_t offset = state->buckets[bucket_index(event_id)];
+  while (offset != 0) {
+    struct SharedEvent* event = shared_at(state, offset);
+    if (event->id == event_id) {
+      return event;
+    }
+    offset = event->bucket_next;
+  }
+  return NULL;
+}
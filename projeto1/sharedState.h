@@ -0,0 +1,81 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SHARED_BUCKETS 4096  // Hash buckets of the shared event registry, a power of two
+
+/// EMS state kept in a single MAP_SHARED region, so every process forked after it is created books against
+/// the same events. The region may be mapped at a different address in each process, so everything in it
+/// refers to the rest through offsets from its start instead of pointers, with 0 meaning none.
+/// Memory is handed out by bumping an offset and never given back, the region is only unmapped at the end.
+
+struct SharedEvent {
+  unsigned int id;              // Event id
+  atomic_uint reservations;     // Number of reservations for the event
+  size_t rows;                  // Number of rows
+  size_t cols;                  // Number of columns
+  pthread_rwlock_t event_lock;  // Process-shared, held for writing by reservations
+  size_t data;                  // Offset of the rows * cols seats, each an atomic_uint
+  size_t next;                  // Offset of the next event in creation order
+  size_t bucket_next;           // Offset of the next event in the same bucket
+};
+
+struct SharedState {
+  pthread_rwlock_t list_lock;      // Process-shared, held for writing while creating events
+  size_t size;                     // Bytes mapped
+  size_t used;                     // Bytes handed out so far, this header included
+  size_t head;                     // Offset of the first event created
+  size_t tail;                     // Offset of the last event created
+  size_t num_events;               // Number of events
+  size_t buckets[SHARED_BUCKETS];  // Offset of the first event of each bucket
+};
+
+/// Maps a new shared region and initializes its header.
+/// @note Must be called before forking, so the children inherit the mapping.
+/// @param size Bytes to map, pages are only backed once used.
+/// @return The state, NULL on failure.
+struct SharedState* shared_state_create(size_t size);
+
+/// Unmaps the region from the calling process, the others keep using it.
+/// @param state State to unmap.
+void shared_state_destroy(struct SharedState* state);
+
+/// Gets the address of an offset in the calling process.
+/// @param state Shared state.
+/// @param offset Offset from the start of the region.
+/// @return Address of the offset.
+void* shared_at(struct SharedState* state, size_t offset);
+
+/// Hands out zeroed memory from the region.
+/// @note Must be called with list_lock held for writing.
+/// @param state Shared state.
+/// @param size Bytes needed.
+/// @return Offset of the memory, 0 if the region is full.
+size_t shared_alloc(struct SharedState* state, size_t size);
+
+/// Creates an event with every seat free, without adding it to the registry.
+/// @note Must be called with list_lock held for writing.
+/// @param state Shared state.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return Offset of the event, 0 on failure.
+size_t shared_new_event(struct SharedState* state, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Adds an event to the registry.
+/// @note Must be called with list_lock held for writing.
+/// @param state Shared state.
+/// @param offset Offset of the event.
+void shared_append_event(struct SharedState* state, size_t offset);
+
+/// Retrieves an event from the registry.
+/// @note Must be called with list_lock held.
+/// @param state Shared state.
+/// @param event_id Event id.
+/// @return Pointer to the event if found, NULL otherwise.
+struct SharedEvent* shared_get_event(struct SharedState* state, unsigned int event_id);
+
+#endif  // SHARED_STATE_H
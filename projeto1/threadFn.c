@@ -1,5 +1,6 @@
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,131 +16,547 @@
 #include "parser.h"
 #include "threadFn.h"
 #include "processFile.h"
+#include "jobFile.h"
+#include "eventlist.h"
 
 #include <linux/limits.h>
 #include <sys/stat.h>
 
 
-void* thread_fn(void* arg) {
-  args_t* args = (args_t*) arg;
-  int output_fd = args->output_fd;
-  unsigned int event_id, delay = 0, thread_id = 0;
-  size_t num_rows, num_columns, num_coords;
-  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
-  int input_fd = args->input_fd;
-  int execute=0;
-  int* result = NULL; 
-
-  while(1) {
-    if (args->barried==0){
-      for (size_t i = 0; i < args->wait_list_size; i++) {
-        if (args->wait_list[i] == args->line_counter) {
-            delay = args->delay_list[i];
-            ems_wait(delay);
+enum Stop {
+  STOP_WAIT,     // The worker has to wait before queueing more lines
+  STOP_SPLIT,    // The worker has to run its lines before queueing more, which depend on them
+  STOP_BARRIER,  // The segment ends at a BARRIER, or at a LIST in event affinity mode
+  STOP_END       // The file ended
+};
+
+int pool_init(struct Pool* pool, const struct JobFile* job, int num_workers, int affinity) {
+  // Round-robin gives each worker at most this many lines between two stops, affinity may give it all of them
+  size_t capacity = affinity ? job->num_lines + 1 : job->num_lines / (size_t)num_workers + 1;
+
+  pool->deques = malloc((size_t)num_workers * sizeof(struct Deque));
+  if (pool->deques == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return 1;
+  }
+
+  pool->outputs = malloc((size_t)num_workers * sizeof(struct OutputBuffer));
+  if (pool->outputs == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    free(pool->deques);
+    return 1;
+  }
+  for (int i = 0; i < num_workers; i++) {
+    output_init(&pool->outputs[i]);
+  }
+
+  pool->events = NULL;
+  if (affinity) {
+    pool->events = calloc((size_t)num_workers, sizeof(struct EventList*));
+    for (int i = 0; pool->events != NULL && i < num_workers; i++) {
+      pool->events[i] = create_list();
+      if (pool->events[i] == NULL) {
+        for (int j = 0; j < i; j++) {
+          free_list(pool->events[j]);
         }
+        free(pool->events);
+        pool->events = NULL;
       }
-      for (size_t i = 0; i < args->barrier_list_size; i++) {
-        if (args->barrier_list[i] == args->line_counter) {
-          args->barried=1;
-          result = malloc(sizeof(int));
-          *result = 1;
-          pthread_exit(result);
-        }
-      } 
-    } else if(args->barried==1){
-      args->barried=0;
-    }
-    args->line_counter++;
-    if (args->line_counter%args->MAX_THREADS == args->thread_id ||
-        (args->line_counter%args->MAX_THREADS==0 && args->thread_id==args->MAX_THREADS)) {
-      execute = 1;
-    } else{
-      execute = 0;
-    }
-    switch (get_next(input_fd)) {
-      case CMD_CREATE:
-        if (parse_create(input_fd, &event_id, &num_rows, &num_columns) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
+    }
+    if (pool->events == NULL) {
+      fprintf(stderr, "Error: Memory allocation failed\n");
+      free(pool->outputs);
+      free(pool->deques);
+      return 1;
+    }
+  }
+  for (int i = 0; i < num_workers; i++) {
+    pool->deques[i].lines = malloc(capacity * sizeof(struct QueuedLine));
+    if (pool->deques[i].lines == NULL) {
+      fprintf(stderr, "Error: Memory allocation failed\n");
+      for (int j = 0; j < i; j++) {
+        pthread_mutex_destroy(&pool->deques[j].lock);
+        free(pool->deques[j].lines);
+      }
+      for (int j = 0; affinity && j < num_workers; j++) {
+        free_list(pool->events[j]);
+      }
+      free(pool->events);
+      free(pool->outputs);
+      free(pool->deques);
+      return 1;
+    }
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+    pool->deques[i].head = 0;
+    pool->deques[i].tail = 0;
+    atomic_init(&pool->deques[i].stolen, 0);
+  }
 
-        if (execute==1){
-          if (ems_create(event_id, num_rows, num_columns)) {
-            fprintf(stderr, "Failed to create event\n");
-            continue;
-          }
-        }
+  pool->num_workers = num_workers;
+  pool->affinity = affinity;
+  atomic_init(&pool->queued, 0);
+  atomic_init(&pool->pushes, 0);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->barrier, NULL);
+  pool->loading = num_workers;
+  pool->arrived = 0;
+  pool->generation = 0;
+  pool->aborted = 0;
+  return 0;
+}
 
-        break;
+void pool_abort(struct Pool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->aborted = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_cond_broadcast(&pool->barrier);
+  pthread_mutex_unlock(&pool->lock);
+}
 
-      case CMD_RESERVE:
-        num_coords = parse_reserve(input_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
-        if (num_coords == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
+int pool_flush(struct Pool* pool, int output_fd) {
+  return output_flush(pool->outputs, (size_t)pool->num_workers, output_fd);
+}
+
+void pool_destroy(struct Pool* pool) {
+  for (int i = 0; i < pool->num_workers; i++) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].lines);
+    output_destroy(&pool->outputs[i]);
+  }
+  free(pool->deques);
+  free(pool->outputs);
+  for (int i = 0; pool->affinity && i < pool->num_workers; i++) {
+    free_list(pool->events[i]);
+  }
+  free(pool->events);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->barrier);
+}
+
+/// Gets the worker that runs a line.
+/// @param pool Pool the line runs in.
+/// @param command Command of the line.
+/// @param line Line (0-based).
+/// @return Thread id of the worker.
+static int line_owner(const struct Pool* pool, const struct JobCommand* command, size_t line) {
+  if (pool->affinity &&
+      (command->type == CMD_CREATE || command->type == CMD_RESERVE || command->type == CMD_SHOW)) {
+    // The high bits of a multiplicative hash spread nearby ids over every worker
+    uint64_t hash = (uint32_t)(command->event_id * 2654435761u);
+    return (int)((hash * (uint64_t)pool->num_workers) >> 32) + 1;
+  }
+
+  // Lines are numbered from 1, the last thread gets the multiples of MAX_THREADS
+  return (int)(line % (size_t)pool->num_workers) + 1;
+}
+
+/// Orders queued lines in chains of lines on the same event, each in file order. Lines that touch no event
+/// come first, each in a chain of its own.
+static int compare_queued(const void* a, const void* b) {
+  const struct QueuedLine* line_a = a;
+  const struct QueuedLine* line_b = b;
+  if (line_a->has_event != line_b->has_event) {
+    return line_a->has_event - line_b->has_event;
+  }
+  if (line_a->has_event && line_a->event_id != line_b->event_id) {
+    return (line_a->event_id > line_b->event_id) - (line_a->event_id < line_b->event_id);
+  }
+  return (line_a->line > line_b->line) - (line_a->line < line_b->line);
+}
+
+/// Checks whether two queued lines belong to the same chain.
+static int same_chain(const struct QueuedLine* a, const struct QueuedLine* b) {
+  return a->has_event && b->has_event && a->event_id == b->event_id;
+}
+
+/// Blocks a worker until every line stolen from it finished.
+/// @param args the arguments of the worker
+static void wait_stolen(args_t* args) {
+  struct Pool* pool = args->pool;
+  struct Deque* deque = &pool->deques[args->thread_id - 1];
+
+  pthread_mutex_lock(&pool->lock);
+  while (atomic_load(&deque->stolen) > 0) {
+    pthread_cond_wait(&pool->work, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/// Queues the lines a worker owns from a line up to its next stop.
+/// @note The lines queued at once run in chains that may be stolen and run in any order, so the queue is split
+/// before a second CREATE, which would change the order LIST prints the events in, and around a LIST.
+/// @param args the arguments of the worker
+/// @param next Pointer to the first line to look at (0-based), left after the stop, or on the line that
+/// starts the next queue after a STOP_SPLIT.
+/// @param delay Pointer to the variable to store the delay of a WAIT in.
+/// @return Where the worker stopped.
+static enum Stop queue_lines(args_t* args, size_t* next, unsigned int* delay) {
+  const struct JobFile* job = args->job;
+  struct Pool* pool = args->pool;
+  struct Deque* deque = &pool->deques[args->thread_id - 1];
+  enum Stop stop = STOP_END;
+  size_t queued = 0;
+  int created = 0;
+
+  // Thieves run the lines they took from the deque in place
+  wait_stolen(args);
+
+  pthread_mutex_lock(&deque->lock);
+  deque->head = 0;
+  deque->tail = 0;
+  for (; *next < job->num_lines; (*next)++) {
+    const struct JobCommand* command = &job->commands[*next];
+    if (command->type == CMD_BARRIER || (pool->affinity && command->type == CMD_LIST_EVENTS)) {
+      stop = STOP_BARRIER;
+      (*next)++;
+      break;
+    }
+    if (command->type == CMD_WAIT &&
+        (command->thread_id == 0 || command->thread_id == (unsigned int)args->thread_id)) {
+      stop = STOP_WAIT;
+      *delay = command->delay;
+      (*next)++;
+      break;
+    }
+    if (command->type == CMD_WAIT || command->type == CMD_EMPTY ||
+        line_owner(pool, command, *next) != args->thread_id) {
+      continue;
+    }
+
+    int list = command->type == CMD_LIST_EVENTS;
+    if (!pool->affinity && queued > 0 && (list || (command->type == CMD_CREATE && created))) {
+      stop = STOP_SPLIT;
+      break;
+    }
+    int has_event = command->type == CMD_CREATE || command->type == CMD_RESERVE || command->type == CMD_SHOW;
+    deque->lines[deque->tail++] = (struct QueuedLine){*next, has_event ? command->event_id : 0, has_event};
+    queued++;
+    created |= command->type == CMD_CREATE;
+    if (list && *next + 1 < job->num_lines) {
+      stop = STOP_SPLIT;
+      (*next)++;
+      break;
+    }
+  }
+
+  // Lines on different events do not depend on each other, so only the order within each event is kept.
+  // Nothing is stolen in event affinity mode, where the lines run in file order.
+  if (!pool->affinity) {
+    qsort(deque->lines, deque->tail, sizeof(struct QueuedLine), compare_queued);
+  }
+  atomic_fetch_add(&pool->queued, queued);
+  pthread_mutex_unlock(&deque->lock);
+
+  if (queued > 0 || (stop != STOP_WAIT && stop != STOP_SPLIT)) {
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->pushes, 1);
+    if (stop != STOP_WAIT && stop != STOP_SPLIT) {
+      pool->loading--;
+    }
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return stop;
+}
+
+/// Takes the next line of a worker's own deque.
+/// @param args the arguments of the worker
+/// @param line Pointer to the variable to store the line in.
+/// @return 1 if a line was taken, 0 if the deque is empty.
+static int pop_line(args_t* args, size_t* line) {
+  struct Deque* deque = &args->pool->deques[args->thread_id - 1];
+  int found = 0;
+
+  size_t left = 1;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    *line = deque->lines[deque->head++].line;
+    left = atomic_fetch_sub(&args->pool->queued, 1) - 1;
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  // Workers waiting for lines that could not be stolen are done once every line was taken
+  if (left == 0) {
+    pthread_mutex_lock(&args->pool->lock);
+    pthread_cond_broadcast(&args->pool->work);
+    pthread_mutex_unlock(&args->pool->lock);
+  }
+  return found;
+}
+
+/// Takes the last chain of another worker's deque, unless its owner already started running it.
+/// @param args the arguments of the thief
+/// @param victim Pointer to store the deque the chain was taken from in.
+/// @param first Pointer to store the index of the first line of the chain in.
+/// @param count Pointer to store the number of lines of the chain in.
+/// @return 1 if a chain was stolen, 0 if there was none to steal.
+static int steal_chain(args_t* args, struct Deque** victim, size_t* first, size_t* count) {
+  struct Pool* pool = args->pool;
+
+  for (int i = 1; i < pool->num_workers; i++) {
+    struct Deque* deque = &pool->deques[(args->thread_id - 1 + i) % pool->num_workers];
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+      const struct QueuedLine* last = &deque->lines[deque->tail - 1];
+      size_t start = deque->tail - 1;
+      while (start > deque->head && same_chain(&deque->lines[start - 1], last)) {
+        start--;
+      }
+
+      // The line before the head may still be running on the owner
+      if (deque->head == 0 || start > deque->head || !same_chain(&deque->lines[deque->head - 1], last)) {
+        *first = start;
+        *count = deque->tail - start;
+        deque->tail = start;
+        atomic_fetch_sub(&pool->queued, *count);
+        atomic_fetch_add(&deque->stolen, *count);
+        found = 1;
+      }
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    if (found) {
+      *victim = deque;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Blocks an idle worker until there are lines to steal or the segment is done.
+/// @note Lines left only in chains their owners are running cannot be stolen, so a worker that found nothing
+/// to steal waits for more lines to be queued, or for every line to be taken.
+/// @param pool Pool of the worker.
+/// @param seen Number of times lines were queued before the worker last looked for lines to steal.
+/// @return 1 if there may be lines to steal, 0 if the segment is done or the pool aborted.
+static int wait_for_work(struct Pool* pool, size_t seen) {
+  pthread_mutex_lock(&pool->lock);
+  while (atomic_load(&pool->queued) > 0 && atomic_load(&pool->pushes) == seen && !pool->aborted) {
+    pthread_cond_wait(&pool->work, &pool->lock);
+  }
+  while (atomic_load(&pool->queued) == 0 && pool->loading > 0 && !pool->aborted) {
+    pthread_cond_wait(&pool->work, &pool->lock);
+  }
+  int more = atomic_load(&pool->queued) > 0 && !pool->aborted;
+  pthread_mutex_unlock(&pool->lock);
+  return more;
+}
+
+/// Records what a line appended to its worker's output, so it is written in the place of the line.
+/// A line that failed may have appended part of its output, which is dropped.
+/// @param out Output buffer of the worker.
+/// @param line Line that ran (0-based).
+/// @param start Size of the buffer before the line ran.
+/// @param failed Whether the command of the line failed.
+static void keep_output(struct OutputBuffer* out, size_t line, size_t start, int failed) {
+  if (failed) {
+    out->size = start;
+  } else if (out->size > start && output_record(out, line, start) != 0) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    out->size = start;
+  }
+}
+
+/// Runs the command of a line.
+/// @param args the arguments of the thread running it
+/// @param line Line to run (0-based).
+static void run_line(args_t* args, size_t line) {
+  const struct JobFile* job = args->job;
+  const struct JobCommand* command = &job->commands[line];
+  struct Pool* pool = args->pool;
+  struct OutputBuffer* out = &pool->outputs[args->thread_id - 1];
+  size_t start = out->size;
+  int failed;
+
+  // In event affinity mode the worker owns the events it touches and uses them without locks
+  if (pool->affinity) {
+    struct EventList* events = pool->events[args->thread_id - 1];
+    switch (command->type) {
+      case CMD_CREATE:
+        if (ems_create_owned(events, command->event_id, command->num_rows, command->num_cols)) {
+          fprintf(stderr, "Failed to create event\n");
         }
-        if (execute==1){
-          if (ems_reserve(event_id, num_coords, xs, ys)) {
-            fprintf(stderr, "Failed to reserve seats\n");
-            continue;
-          }
+        return;
+
+      case CMD_RESERVE:
+        if (ems_reserve_owned(events, command->event_id, command->num_coords, job->xs + command->first_coord,
+                              job->ys + command->first_coord)) {
+          fprintf(stderr, "Failed to reserve seats\n");
         }
-        break;
+        return;
 
       case CMD_SHOW:
-        if (parse_show(input_fd, &event_id) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
+        failed = ems_show_owned(events, command->event_id, out);
+        if (failed) {
+          fprintf(stderr, "Failed to show event\n");
         }
-        if (execute==1){
-          if (ems_show(event_id, output_fd, args->lock_output_writing)) {
-            fprintf(stderr, "Failed to show event\n");
-            continue;
-          }
-        }
-        break;
+        keep_output(out, line, start, failed);
+        return;
 
       case CMD_LIST_EVENTS:
-        if (execute==1){
-          if (ems_list_events(output_fd, args->lock_output_writing)) {
-            fprintf(stderr, "Failed to list events\n");
-            continue;
-          }
+        failed = ems_list_owned_events(pool->events, (size_t)pool->num_workers, out);
+        if (failed) {
+          fprintf(stderr, "Failed to list events\n");
         }
-        break;
+        keep_output(out, line, start, failed);
+        return;
 
+      case CMD_BARRIER:
       case CMD_WAIT:
-        (parse_wait(input_fd, &delay, &thread_id));
-        break;
-
+      case CMD_HELP:
+      case CMD_EMPTY:
       case CMD_INVALID:
-        if (execute==1){
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-        }
+      case EOC:
         break;
+    }
+  }
 
-      case CMD_HELP:
-        if (execute==1){
-          printf(
-            "Available commands:\n"
-            "  CREATE <event_id> <num_rows> <num_columns>\n"
-            "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-            "  SHOW <event_id>\n"
-            "  LIST\n"
-            "  WAIT <delay_ms> [thread_id]\n" 
-            "  BARRIER\n"                      
-            "  HELP\n");
-        }
-        break;
+  switch (command->type) {
+    case CMD_CREATE:
+      if (ems_create(command->event_id, command->num_rows, command->num_cols)) {
+        fprintf(stderr, "Failed to create event\n");
+      }
+      break;
 
-      case CMD_BARRIER:
+    case CMD_RESERVE:
+      if (ems_reserve(command->event_id, command->num_coords, job->xs + command->first_coord,
+                      job->ys + command->first_coord)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+      break;
+
+    case CMD_SHOW:
+      failed = ems_show(command->event_id, out);
+      if (failed) {
+        fprintf(stderr, "Failed to show event\n");
+      }
+      keep_output(out, line, start, failed);
+      break;
+
+    case CMD_LIST_EVENTS:
+      failed = ems_list_events(out);
+      if (failed) {
+        fprintf(stderr, "Failed to list events\n");
+      }
+      keep_output(out, line, start, failed);
+      break;
+
+    case CMD_INVALID:
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      break;
+
+    case CMD_HELP:
+      printf(
+        "Available commands:\n"
+        "  CREATE <event_id> <num_rows> <num_columns>\n"
+        "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+        "  SHOW <event_id>\n"
+        "  LIST\n"
+        "  WAIT <delay_ms> [thread_id]\n" 
+        "  BARRIER\n"                      
+        "  HELP\n");
+      break;
+
+    case CMD_WAIT:
+    case CMD_BARRIER:
+    case CMD_EMPTY:
+    case EOC:
+      break;
+  }
+}
+
+/// Runs a chain stolen from another worker and lets its owner know once it finished.
+/// @param args the arguments of the thief
+/// @param victim Deque the chain was taken from.
+/// @param first Index of the first line of the chain.
+/// @param count Number of lines of the chain.
+static void run_stolen(args_t* args, struct Deque* victim, size_t first, size_t count) {
+  for (size_t i = first; i < first + count; i++) {
+    run_line(args, victim->lines[i].line);
+  }
+
+  atomic_fetch_sub(&victim->stolen, count);
+  pthread_mutex_lock(&args->pool->lock);
+  pthread_cond_broadcast(&args->pool->work);
+  pthread_mutex_unlock(&args->pool->lock);
+}
+
+/// Waits until every worker reaches the barrier, the last one to arrive writes the output of the segment
+/// and opens the next one.
+/// @note A LIST that stops the segment in event affinity mode runs on the last worker, while the others wait.
+/// @param args the arguments of the worker
+/// @param line Line that ended the segment (0-based).
+/// @return 0 if every worker arrived, 1 if the pool aborted.
+static int wait_barrier(args_t* args, size_t line) {
+  struct Pool* pool = args->pool;
+  pthread_mutex_lock(&pool->lock);
+  unsigned long generation = pool->generation;
+  if (++pool->arrived == pool->num_workers) {
+    if (args->job->commands[line].type == CMD_LIST_EVENTS) {
+      run_line(args, line);
+    }
+    pool_flush(pool, args->output_fd);
+    pool->arrived = 0;
+    pool->loading = pool->num_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->barrier);
+  } else {
+    while (generation == pool->generation && !pool->aborted) {
+      pthread_cond_wait(&pool->barrier, &pool->lock);
+    }
+  }
+  int aborted = pool->aborted;
+  pthread_mutex_unlock(&pool->lock);
+  return aborted;
+}
+
+void* thread_fn(void* arg) {
+  args_t* args = (args_t*) arg;
+  struct Pool* pool = args->pool;
+  size_t next = 0, line;
+  unsigned int delay = 0;
+
+  while (1) {
+    enum Stop stop = queue_lines(args, &next, &delay);
+    while (1) {
+      while (pop_line(args, &line)) {
+        run_line(args, line);
+      }
+
+      // A WAIT holds back the rest of the worker's lines, so nobody can steal them while it sleeps
+      if (stop == STOP_WAIT) {
+        ems_wait(delay);
+        stop = queue_lines(args, &next, &delay);
+        continue;
+      }
+
+      // The lines after a split are only queued once the lines before it ran, stolen ones included
+      if (stop == STOP_SPLIT) {
+        stop = queue_lines(args, &next, &delay);
+        continue;
+      }
+
+      // Lines never move in event affinity mode, they would run on events another worker owns
+      if (pool->affinity) {
         break;
-      case CMD_EMPTY:
+      }
+      struct Deque* victim;
+      size_t first, count, seen = atomic_load(&pool->pushes);
+      if (steal_chain(args, &victim, &first, &count)) {
+        run_stolen(args, victim, first, count);
+      } else if (!wait_for_work(pool, seen)) {
         break;
+      }
+    }
 
-      case EOC:
-        close(input_fd);
-        pthread_exit(NULL); 
+    if (stop == STOP_END || wait_barrier(args, next - 1)) {
+      return NULL;
     }
   }
-}
\ No newline at end of file
+}
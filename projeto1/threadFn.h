@@ -1,26 +1,93 @@
 #ifndef THREAD_FN_H
 #define THREAD_FN_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <pthread.h>
 
+#include "jobFile.h"
+#include "outputBuffer.h"
+
+/// Line queued for a worker, with the event that orders it after the worker's earlier lines on that event.
+struct QueuedLine {
+  size_t line;            // Line to run (0-based)
+  unsigned int event_id;  // Event the line touches, valid if has_event
+  int has_event;          // Whether the line is a CREATE, RESERVE or SHOW
+};
+
+/// Lines queued for one worker, grouped in chains of lines on the same event, each chain in file order.
+/// The owner runs them from the head while idle workers steal whole chains from the tail, so the lines
+/// a worker owns on an event still run one after the other, in file order.
+/// @note Stolen lines keep their slots until the thief is done with them, the owner only refills the
+/// deque once none of them is running.
+struct Deque {
+  pthread_mutex_t lock;      // Protects the lines and both ends
+  struct QueuedLine *lines;  // Lines to run, room for every line the owner can queue at once
+  size_t head;               // Index of the next line the owner runs
+  size_t tail;               // Index after the last line queued
+  atomic_size_t stolen;      // Lines taken by thieves that did not finish yet
+};
+
+/// Workers that live for the whole file. Each BARRIER ends a segment, and every worker waits for the
+/// others before starting the next one instead of being torn down and created again.
+/// The lines a worker owns are queued in parts that hold at most one CREATE, or a LIST alone, so LIST sees
+/// the events each worker created in the same order as if it ran its lines in file order.
+/// In event affinity mode CREATE, RESERVE and SHOW go to the worker their event id hashes to, which keeps
+/// the event in its own list and never locks it. Nothing is stolen, and LIST ends a segment like BARRIER.
+/// Output goes to the buffer of the worker running the line and is written in line order at every barrier
+/// and at the end of the file, so the .out file does not depend on which worker ran what.
+struct Pool {
+  struct Deque *deques;          // One per worker, indexed by thread_id - 1
+  struct EventList **events;     // Events owned by each worker in event affinity mode, NULL otherwise
+  struct OutputBuffer *outputs;  // Output of each worker since the last barrier, indexed by thread_id - 1
+  int num_workers;               // Number of workers
+  int affinity;                  // Whether lines are routed by event id instead of by line number
+  atomic_size_t queued;          // Lines waiting in all deques
+  atomic_size_t pushes;          // Times lines were queued, bumped with the lock held
+  pthread_mutex_t lock;          // Protects everything below
+  pthread_cond_t work;           // Signaled when lines are queued, loading drops to 0 or the pool aborts
+  pthread_cond_t barrier;        // Signaled when every worker reaches a barrier or the pool aborts
+  int loading;                   // Workers that still have lines of the current segment to queue
+  int arrived;                   // Workers waiting at the current barrier
+  unsigned long generation;      // Number of barriers passed
+  int aborted;                   // Set when not every worker could be started
+};
+
 typedef struct {
-  int input_fd;
+  const struct JobFile* job;  // Commands of the job file, shared read-only by every thread
+  struct Pool* pool;          // Pool the thread works in
   int output_fd;
   int thread_id;
   int MAX_THREADS;
-  int line_counter;
-  int barried;
-  int* wait_list;
-  int* barrier_list;
-  size_t wait_list_size;
-  size_t barrier_list_size;
-  unsigned int *delay_list;
-  pthread_mutex_t* lock_output_writing;
   char *job_path;
 } args_t;  // the arguments of each thread
 
+/// Initializes a pool with an empty deque for each worker.
+/// @param pool Pool to initialize.
+/// @param job Job file the workers will run.
+/// @param num_workers Number of workers.
+/// @param affinity Whether to route lines by event id, see EVENT_AFFINITY.
+/// @return 0 if successful, 1 on error.
+int pool_init(struct Pool* pool, const struct JobFile* job, int num_workers, int affinity);
+
+/// Wakes every worker blocked in the pool so they return, used when not every worker could be started.
+/// @param pool Pool to abort.
+void pool_abort(struct Pool* pool);
+
+/// Writes the output still buffered by the workers, once they have been joined.
+/// @param pool Pool to flush.
+/// @param output_fd File descriptor of the .out file.
+/// @return 0 if successful, 1 on error.
+int pool_flush(struct Pool* pool, int output_fd);
+
+/// Frees a pool once its workers have been joined.
+/// @param pool Pool to destroy.
+void pool_destroy(struct Pool* pool);
+
 /// The thread function that executes the commands
+/// @note Each worker queues the lines it owns (line % MAX_THREADS, or by event id in event affinity mode) up to
+/// its next WAIT, LIST, BARRIER or the end of the file, runs them and then steals chains of lines from the
+/// others until the segment is done.
 /// @param arg the arguments of the thread
 void* thread_fn(void* arg);
 
@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/constants.h"
+#include "server/operations.h"
+
+// Reservation throughput on a single hot event as the number of sessions reserving on it grows. Each session
+// is a thread with its own event cache reserving its own slice of the seats, so every reservation succeeds.
+// The striped event is large enough to be striped from creation. The other one has a few columns less, so it
+// starts on a single lock and is only striped once its lock was found taken STRIPE_CONTENTION_THRESHOLD times.
+// Usage: contention [most sessions], 32 by default.
+
+#define HOT_ROWS 1024        // Rows of each hot event
+#define HOT_COLS 64          // Columns of the striped event, HOT_ROWS * HOT_COLS is STRIPE_MIN_SEATS
+#define SEATS_PER_RESERVE 4  // Seats of each reservation, side by side in a row
+#define ROUNDS 8             // Events filled for each measurement
+
+/// Arguments of a session thread.
+struct Session {
+  pthread_t thread;
+  pthread_barrier_t* start;  // Released once every session of the round is ready
+  unsigned int event_id;     // Event to reserve on
+  size_t cols;               // Columns of the event
+  size_t first;              // First reservation of the slice of the session
+  size_t count;              // Number of reservations in the slice
+  size_t failed;             // Reservations that failed
+};
+
+/// Reserves the slice of seats of a session, in groups of SEATS_PER_RESERVE seats in row-major order.
+static void* reserve_slice(void* arg) {
+  struct Session* session = arg;
+  struct EventCache cache;
+  ems_cache_reset(&cache);
+  pthread_barrier_wait(session->start);
+
+  for (size_t i = session->first; i < session->first + session->count; i++) {
+    size_t xs[SEATS_PER_RESERVE], ys[SEATS_PER_RESERVE];
+    for (size_t j = 0; j < SEATS_PER_RESERVE; j++) {
+      size_t seat = i * SEATS_PER_RESERVE + j;
+      xs[j] = seat / session->cols + 1;
+      ys[j] = seat % session->cols + 1;
+    }
+    session->failed += ems_reserve(session->event_id, SEATS_PER_RESERVE, xs, ys, &cache) != 0;
+  }
+  return NULL;
+}
+
+/// Fills ROUNDS new events of the given shape with a number of sessions.
+/// @param next_id Pointer to the id of the next event to create.
+/// @param cols Columns of the events, a multiple of SEATS_PER_RESERVE.
+/// @param num_sessions Number of sessions.
+/// @return Reservations per second, or a negative number on failure.
+static double bench_shape(unsigned int* next_id, size_t cols, size_t num_sessions) {
+  size_t rows = HOT_ROWS;
+  size_t num_reserves = rows * cols / SEATS_PER_RESERVE;
+  struct Session sessions[num_sessions];
+  pthread_barrier_t start;
+  double seconds = 0;
+
+  for (size_t round = 0; round < ROUNDS; round++) {
+    unsigned int event_id = (*next_id)++;
+    if (ems_create(event_id, rows, cols) != 0) return -1;
+    pthread_barrier_init(&start, NULL, (unsigned int)num_sessions + 1);
+
+    // Contiguous slices keep the sessions on different rows, and so on different stripes when there are any
+    for (size_t i = 0; i < num_sessions; i++) {
+      size_t first = num_reserves * i / num_sessions;
+      sessions[i] = (struct Session){0, &start, event_id, cols, first, num_reserves * (i + 1) / num_sessions - first, 0};
+      if (pthread_create(&sessions[i].thread, NULL, reserve_slice, &sessions[i]) != 0) return -1;
+    }
+
+    struct timespec begin, end;
+    pthread_barrier_wait(&start);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    size_t failed = 0;
+    for (size_t i = 0; i < num_sessions; i++) {
+      pthread_join(sessions[i].thread, NULL);
+      failed += sessions[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&start);
+
+    if (failed > 0) return -1;
+    seconds += (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+  }
+  return (double)(ROUNDS * num_reserves) / seconds;
+}
+
+int main(int argc, char* argv[]) {
+  size_t most_sessions = argc > 1 ? strtoul(argv[1], NULL, 10) : 32;
+  if (most_sessions == 0 || ems_init(0, EVENT_SHARD_COUNT) != 0) {
+    fprintf(stderr, "Usage: %s [most sessions]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int next_id = 1;
+  printf("%8s %16s %18s\n", "sessions", "striped res/s", "unstriped res/s");
+  for (size_t num_sessions = 1; num_sessions <= most_sessions; num_sessions *= 2) {
+    double striped = bench_shape(&next_id, HOT_COLS, num_sessions);
+    double unstriped = bench_shape(&next_id, HOT_COLS - SEATS_PER_RESERVE, num_sessions);
+    if (striped < 0 || unstriped < 0) {
+      fprintf(stderr, "Reservations failed\n");
+      return 1;
+    }
+    printf("%8zu %16.0f %18.0f\n", num_sessions, striped, unstriped);
+  }
+
+  ems_terminate();
+  return 0;
+}
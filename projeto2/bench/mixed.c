@@ -0,0 +1,163 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/protocol.h"
+#include "server/operations.h"
+#include "server/outbox.h"
+
+// Reservation throughput while other sessions keep showing the event being reserved. Writers fill a new event
+// in each round, in disjoint slices of 4-seat reservations, while readers SHOW it in a loop until the writers are
+// done. Every SHOW is written to /dev/null through an outbox, as a session would answer it.
+// Usage: mixed [writers] [most readers], 2 and 8 by default.
+
+#define EVENT_ROWS 1024      // Rows of each event
+#define EVENT_COLS 64        // Columns of each event
+#define SEATS_PER_RESERVE 4  // Seats of each reservation, side by side in a row
+#define ROUNDS 8             // Events filled for each measurement
+
+/// State shared by the sessions of a round.
+struct Round {
+  pthread_barrier_t start;   // Released once every session of the round is ready
+  unsigned int event_id;     // Event of the round
+  atomic_int writing;        // Writers still reserving
+  atomic_size_t shows;       // SHOWs answered
+  atomic_size_t failed;      // Requests that failed
+  size_t num_writers;        // Number of writers
+};
+
+/// Arguments of a session thread.
+struct Session {
+  pthread_t thread;
+  struct Round* round;
+  size_t index;  // Index of the writer, to pick its slice
+  int fd;        // File descriptor readers answer to
+};
+
+/// Reserves the slice of seats of a writer.
+static void* write_seats(void* arg) {
+  struct Session* session = arg;
+  struct Round* round = session->round;
+  size_t num_reserves = EVENT_ROWS * EVENT_COLS / SEATS_PER_RESERVE;
+  size_t first = num_reserves * session->index / round->num_writers;
+  size_t last = num_reserves * (session->index + 1) / round->num_writers;
+  struct EventCache cache;
+  ems_cache_reset(&cache);
+  pthread_barrier_wait(&round->start);
+
+  for (size_t i = first; i < last; i++) {
+    size_t xs[SEATS_PER_RESERVE], ys[SEATS_PER_RESERVE];
+    for (size_t j = 0; j < SEATS_PER_RESERVE; j++) {
+      xs[j] = (i * SEATS_PER_RESERVE + j) / EVENT_COLS + 1;
+      ys[j] = (i * SEATS_PER_RESERVE + j) % EVENT_COLS + 1;
+    }
+    if (ems_reserve(round->event_id, SEATS_PER_RESERVE, xs, ys, &cache) != 0) {
+      atomic_fetch_add(&round->failed, 1);
+    }
+  }
+  atomic_fetch_sub(&round->writing, 1);
+  return NULL;
+}
+
+/// Shows the event of the round until every writer is done.
+static void* show_seats(void* arg) {
+  struct Session* session = arg;
+  struct Round* round = session->round;
+  struct FrameHeader request = {sizeof(uint32_t), OP_SHOW, 0};
+  struct EventCache cache;
+  struct Outbox out;
+  ems_cache_reset(&cache);
+  outbox_init(&out, session->fd);
+  pthread_barrier_wait(&round->start);
+
+  while (atomic_load(&round->writing) > 0) {
+    if (ems_show(&out, round->event_id, &cache, &request) != 0 || outbox_flush(&out) != 0) {
+      atomic_fetch_add(&round->failed, 1);
+    }
+    atomic_fetch_add(&round->shows, 1);
+  }
+  outbox_destroy(&out);
+  return NULL;
+}
+
+/// Fills ROUNDS new events with writers while readers show them.
+/// @param next_id Pointer to the id of the next event to create.
+/// @param num_writers Number of writers.
+/// @param num_readers Number of readers.
+/// @param fd File descriptor readers answer to.
+/// @param shows Pointer to store the SHOWs per second in.
+/// @return Reservations per second, or a negative number on failure.
+static double bench_mix(unsigned int* next_id, size_t num_writers, size_t num_readers, int fd, double* shows) {
+  size_t num_sessions = num_writers + num_readers;
+  struct Session sessions[num_sessions];
+  struct Round round;
+  double seconds = 0;
+  size_t total_shows = 0;
+
+  for (size_t r = 0; r < ROUNDS; r++) {
+    round.event_id = (*next_id)++;
+    round.num_writers = num_writers;
+    atomic_init(&round.writing, (int)num_writers);
+    atomic_init(&round.shows, 0);
+    atomic_init(&round.failed, 0);
+    if (ems_create(round.event_id, EVENT_ROWS, EVENT_COLS) != 0) return -1;
+    pthread_barrier_init(&round.start, NULL, (unsigned int)num_sessions + 1);
+
+    for (size_t i = 0; i < num_sessions; i++) {
+      sessions[i] = (struct Session){0, &round, i, fd};
+      if (pthread_create(&sessions[i].thread, NULL, i < num_writers ? write_seats : show_seats, &sessions[i]) != 0) {
+        return -1;
+      }
+    }
+
+    struct timespec begin, end;
+    pthread_barrier_wait(&round.start);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (size_t i = 0; i < num_writers; i++) {
+      pthread_join(sessions[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (size_t i = num_writers; i < num_sessions; i++) {
+      pthread_join(sessions[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&round.start);
+
+    if (atomic_load(&round.failed) > 0) return -1;
+    seconds += (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+    total_shows += atomic_load(&round.shows);
+  }
+
+  *shows = (double)total_shows / seconds;
+  return (double)(ROUNDS * EVENT_ROWS * EVENT_COLS / SEATS_PER_RESERVE) / seconds;
+}
+
+int main(int argc, char* argv[]) {
+  size_t num_writers = argc > 1 ? strtoul(argv[1], NULL, 10) : 2;
+  size_t most_readers = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+  int fd = open("/dev/null", O_WRONLY);
+  if (num_writers == 0 || fd == -1 || ems_init(0, EVENT_SHARD_COUNT) != 0) {
+    fprintf(stderr, "Usage: %s [writers] [most readers]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int next_id = 1;
+  printf("%8s %8s %12s %12s\n", "writers", "readers", "res/s", "shows/s");
+  for (size_t num_readers = 0; num_readers <= most_readers; num_readers = num_readers == 0 ? 1 : 2 * num_readers) {
+    double shows;
+    double reserves = bench_mix(&next_id, num_writers, num_readers, fd, &shows);
+    if (reserves < 0) {
+      fprintf(stderr, "Requests failed\n");
+      return 1;
+    }
+    printf("%8zu %8zu %12.0f %12.0f\n", num_writers, num_readers, reserves, shows);
+  }
+
+  ems_terminate();
+  close(fd);
+  return 0;
+}
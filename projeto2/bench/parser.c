@@ -0,0 +1,150 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/parser.h"
+#include "common/constants.h"
+#include "common/io.h"
+
+// How fast the client parses a .jobs file through its buffered reader. A file of mixed CREATE, RESERVE, SHOW,
+// WAIT and LIST lines is generated, then parsed with get_next and the parse_* functions the client runs. For
+// reference, the same file is also read with one read per byte, which is what parsing cost before the reader.
+// Usage: parser [megabytes], 16 by default.
+
+#define SEATS_PER_RESERVE 8  // Coordinates of each generated RESERVE
+
+/// Generates a .jobs file in a temporary file.
+/// @param size Number of bytes to generate, the last line may go past it.
+/// @return File descriptor of the file, positioned at the start, -1 on error.
+static int generate_jobs(size_t size) {
+  char path[] = "/tmp/ems-parser-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) return -1;
+  unlink(path);
+
+  FILE* jobs = fdopen(dup(fd), "w");
+  if (jobs == NULL) return -1;
+  unsigned int seed = 1;
+  for (unsigned int line = 0; (size_t)ftell(jobs) < size; line++) {
+    unsigned int event_id = line / 64 + 1;
+    switch (line % 64) {
+      case 0:
+        fprintf(jobs, "CREATE %u 100 100\n", event_id);
+        break;
+      case 31:
+        fprintf(jobs, "# Halfway through event %u\nWAIT 0\n", event_id);
+        break;
+      case 62:
+        fprintf(jobs, "SHOW %u\n", event_id);
+        break;
+      case 63:
+        fprintf(jobs, "LIST\n");
+        break;
+      default:
+        fprintf(jobs, "RESERVE %u [", event_id);
+        for (int i = 0; i < SEATS_PER_RESERVE; i++) {
+          seed = seed * 1103515245u + 12345u;
+          fprintf(jobs, "%s(%u,%u)", i > 0 ? " " : "", seed % 100 + 1, (seed >> 16) % 100 + 1);
+        }
+        fprintf(jobs, "]\n");
+    }
+  }
+  if (fclose(jobs) != 0) return -1;
+  return lseek(fd, 0, SEEK_SET) == 0 ? fd : -1;
+}
+
+/// Gets the seconds elapsed since a point in time.
+/// @param begin The point in time.
+/// @return Seconds elapsed.
+static double seconds_since(const struct timespec* begin) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (double)(end.tv_sec - begin->tv_sec) + (double)(end.tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+/// Parses every command of a .jobs file, as the client does before sending them.
+/// @param fd File descriptor of the file, positioned at the start.
+/// @return Number of commands parsed successfully.
+static size_t parse_jobs(int fd) {
+  struct Reader in;
+  unsigned int event_id, delay, thread_id;
+  int contiguous;
+  size_t num_rows, num_cols, num_seats, num_coords;
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  size_t parsed = 0;
+  reader_init(&in, fd);
+
+  while (1) {
+    switch (get_next(&in)) {
+      case CMD_CREATE:
+        parsed += parse_create(&in, &event_id, &num_rows, &num_cols) == 0;
+        break;
+      case CMD_RESERVE:
+        num_coords = parse_reserve(&in, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        parsed += num_coords > 0;
+        break;
+      case CMD_RESERVE_BEST:
+        parsed += parse_reserve_best(&in, &event_id, &num_seats, &contiguous) == 0;
+        break;
+      case CMD_SHOW:
+        parsed += parse_show(&in, &event_id) == 0;
+        break;
+      case CMD_WAIT:
+        parsed += parse_wait(&in, &delay, &thread_id) != -1;
+        break;
+      case CMD_LIST_EVENTS:
+      case CMD_HELP:
+      case CMD_BATCH:
+      case CMD_END:
+        parsed++;
+        break;
+      case CMD_EMPTY:
+      case CMD_INVALID:
+        break;
+      case EOC:
+        return parsed;
+    }
+  }
+}
+
+/// Reads a file one byte at a time, counting its lines.
+/// @param fd File descriptor of the file, positioned at the start.
+/// @return Number of lines read.
+static size_t read_bytes(int fd) {
+  size_t lines = 0;
+  char ch;
+  while (read(fd, &ch, 1) == 1) {
+    lines += ch == '\n';
+  }
+  return lines;
+}
+
+int main(int argc, char* argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 16;
+  int fd = megabytes > 0 ? generate_jobs(megabytes << 20) : -1;
+  if (fd == -1) {
+    fprintf(stderr, "Usage: %s [megabytes]\n", argv[0]);
+    return 1;
+  }
+  double size = (double)lseek(fd, 0, SEEK_END) / (1 << 20);
+  struct timespec begin;
+
+  lseek(fd, 0, SEEK_SET);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  size_t parsed = parse_jobs(fd);
+  double parse_seconds = seconds_since(&begin);
+
+  lseek(fd, 0, SEEK_SET);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  size_t lines = read_bytes(fd);
+  double read_seconds = seconds_since(&begin);
+
+  printf("%.1f MB, %zu lines, %zu commands\n", size, lines, parsed);
+  printf("%24s %10s %12s\n", "", "MB/s", "commands/s");
+  printf("%24s %10.1f %12.0f\n", "buffered parser", size / parse_seconds, (double)parsed / parse_seconds);
+  printf("%24s %10.1f %12s\n", "read per byte, no parse", size / read_seconds, "-");
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/io.h"
+
+// How many seats per second a seat map is rendered to /dev/null with print_seats, against formatting every seat
+// with sprintf and writing it separately, as SHOW did before print_seats. Three maps are rendered: an empty one,
+// a half-reserved one and a full one with large reservation ids.
+// Usage: render [rows] [cols], 1000 and 1000 by default.
+
+#define RENDER_SECONDS 0.5  // Least time each renderer is repeated for on each map
+
+/// Renders a seat map with a sprintf and a write per seat, as SHOW did before print_seats.
+/// @param fd The file descriptor to write to.
+/// @param seats Array of size rows * cols with the seats, row by row.
+/// @param rows The number of rows.
+/// @param cols The number of columns.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+static int print_seats_sprintf(int fd, const unsigned int* seats, size_t rows, size_t cols) {
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 1; j <= cols; j++) {
+      char buffer[16];
+      sprintf(buffer, "%u", seats[i * cols + j - 1]);
+      if (print_str(fd, buffer)) return 1;
+      if (j < cols && print_str(fd, " ")) return 1;
+    }
+    if (print_str(fd, "\n")) return 1;
+  }
+  return 0;
+}
+
+/// Renders a seat map repeatedly for at least RENDER_SECONDS.
+/// @param render The renderer.
+/// @param fd The file descriptor to write to.
+/// @param seats Array of size rows * cols with the seats, row by row.
+/// @param rows The number of rows.
+/// @param cols The number of columns.
+/// @return Seats rendered per second, or a negative number on failure.
+static double bench_render(int (*render)(int, const unsigned int*, size_t, size_t), int fd, const unsigned int* seats,
+                           size_t rows, size_t cols) {
+  struct timespec begin, end;
+  double seconds = 0;
+  size_t renders = 0;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  while (seconds < RENDER_SECONDS) {
+    if (render(fd, seats, rows, cols) != 0) return -1;
+    renders++;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+  }
+  return (double)(renders * rows * cols) / seconds;
+}
+
+int main(int argc, char* argv[]) {
+  size_t rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+  size_t cols = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+  int fd = open("/dev/null", O_WRONLY);
+  unsigned int* seats = rows > 0 && cols > 0 ? malloc(rows * cols * sizeof(unsigned int)) : NULL;
+  if (fd == -1 || seats == NULL) {
+    fprintf(stderr, "Usage: %s [rows] [cols]\n", argv[0]);
+    return 1;
+  }
+
+  const char* maps[] = {"empty", "half", "full"};
+  printf("%6s %22s %22s\n", "map", "print_seats seats/s", "sprintf seats/s");
+  for (size_t m = 0; m < 3; m++) {
+    // Reservations of 4 seats, numbered in order, over none, half or all of the map
+    for (size_t i = 0; i < rows * cols; i++) {
+      seats[i] = 2 * i < m * rows * cols ? (unsigned int)(i / 4 + 1) : 0;
+    }
+    double fast = bench_render(print_seats, fd, seats, rows, cols);
+    double slow = bench_render(print_seats_sprintf, fd, seats, rows, cols);
+    if (fast < 0 || slow < 0) {
+      fprintf(stderr, "Failed to write seats\n");
+      return 1;
+    }
+    printf("%6s %22.0f %22.0f\n", maps[m], fast, slow);
+  }
+
+  free(seats);
+  close(fd);
+  return 0;
+}
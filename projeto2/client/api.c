@@ -8,21 +8,110 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <poll.h>
+#include <stdint.h>
 
 #include "api.h"
 #include "common/constants.h"
 #include "common/io.h"
-
-/// Gets the index of a seat.
-/// @note This function assumes that the seat exists.
-/// @param event Event to get the seat index from.
-/// @param row Row of the seat.
-/// @param col Column of the seat.
-/// @return Index of the seat.
-static size_t seat_index(size_t num_cols, size_t row, size_t col) { return (row - 1) * num_cols + col - 1; }
+#include "common/protocol.h"
+
+/// Reads exactly the given number of bytes, the server may write a response in several pieces.
+/// @param fd File descriptor to read from.
+/// @param buffer Buffer to store the bytes in.
+/// @param size Number of bytes to read.
+/// @return 0 if every byte was read, 1 otherwise.
+static int read_full(int fd, void* buffer, size_t size) {
+  char* ptr = buffer;
+  while (size > 0) {
+    ssize_t ret_read = read(fd, ptr, size);
+    if (ret_read == -1 && errno == EINTR) continue;
+    if (ret_read <= 0) return 1;
+    ptr += ret_read;
+    size -= (size_t)ret_read;
+  }
+  return 0;
+}
 
 Client client;
 
+/// Sends a request, the header and the fields go out in a single writev.
+/// @param opcode Op code of the request.
+/// @param fields Fields of the request.
+/// @param num_fields Number of fields.
+/// @param request_id Pointer to the variable to store the id given to the request in.
+/// @return 0 if the request was sent, 1 otherwise.
+static int send_request(uint32_t opcode, const uint32_t* fields, size_t num_fields, uint32_t* request_id) {
+  *request_id = client.next_request_id++;
+  if (frame_write(client.req_pipe, opcode, *request_id, fields, num_fields * sizeof(uint32_t))) {
+    fprintf(stderr, "Failed to write\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Sends a request whose result the caller waits for.
+/// @note Its response would otherwise be mistaken for the result of a request still in flight.
+/// @param opcode Op code of the request.
+/// @param fields Fields of the request.
+/// @param num_fields Number of fields.
+/// @param request_id Pointer to the variable to store the id given to the request in.
+/// @return 0 if the request was sent, 1 otherwise.
+static int send_sync_request(uint32_t opcode, const uint32_t* fields, size_t num_fields, uint32_t* request_id) {
+  if (client.num_pending > 0) {
+    fprintf(stderr, "Results of earlier requests were not taken\n");
+    return 1;
+  }
+  return send_request(opcode, fields, num_fields, request_id);
+}
+
+/// Sends a request whose result is taken later, remembering it as the newest in flight.
+/// @param opcode Op code of the request.
+/// @param fields Fields of the request.
+/// @param num_fields Number of fields.
+/// @param request_id Pointer to the variable to store the id given to the request in.
+/// @return 0 if the request was sent, 1 otherwise.
+static int send_async_request(uint32_t opcode, const uint32_t* fields, size_t num_fields, uint32_t* request_id) {
+  // Keeps the replies not read yet well within what the response pipe holds, so the server never blocks on it
+  if (client.num_pending == ASYNC_MAX_IN_FLIGHT) {
+    fprintf(stderr, "Too many requests in flight\n");
+    return 1;
+  }
+  if (send_request(opcode, fields, num_fields, request_id)) {
+    return 1;
+  }
+
+  size_t slot = (client.pending_head + client.num_pending) % ASYNC_MAX_IN_FLIGHT;
+  client.pending[slot] = (struct PendingRequest){*request_id, opcode};
+  client.num_pending++;
+  return 0;
+}
+
+/// Reads fields of a response from the buffered response pipe.
+/// @param fields Array to store the fields in.
+/// @param num_fields Number of fields to read.
+/// @return 0 if every field was read, 1 otherwise.
+static int read_fields(void* fields, size_t num_fields) {
+  size_t size = num_fields * sizeof(uint32_t);
+  return reader_read(&client.responses, fields, size) != size;
+}
+
+/// Reads the header and the result of the response to a request.
+/// @param opcode Op code of the request.
+/// @param request_id Id of the request.
+/// @param result Pointer to the variable to store the result in.
+/// @return 0 if the response was read, 1 otherwise.
+static int read_response(uint32_t opcode, uint32_t request_id, int* result) {
+  struct FrameHeader header;
+  if (reader_read(&client.responses, (char*)&header, sizeof(header)) != sizeof(header) ||
+      header.opcode != opcode || header.request_id != request_id || header.length < sizeof(int) ||
+      read_fields(result, 1)) {
+    fprintf(stderr, "Failed to read\n");
+    return 1;
+  }
+  return 0;
+}
+
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
   char OP_CODE = '1';
   if (mkfifo(req_pipe_path, 0666) == -1) {
@@ -68,21 +157,38 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
     fprintf(stderr, "Failed to open response pipe\n");
     return 1;
   }
-  int session_id;
-  ssize_t ret_read = read(client.resp_pipe, &session_id, sizeof(int));
-  if (ret_read == -1) {
+  if (read_full(client.resp_pipe, &client.session_id, sizeof(int))) {
       fprintf(stderr, "Failed to read session_id\n");
       exit(EXIT_FAILURE);
   }
   close(server_pipe_fd);
+
+  // The session starts in v1, v2 is asked for before any other request
+  char version_request[sizeof(char) + sizeof(uint32_t)];
+  char version_op = OP_VERSION;
+  uint32_t version = PROTOCOL_VERSION;
+  memcpy(version_request, &version_op, sizeof(char));
+  memcpy(version_request + sizeof(char), &version, sizeof(uint32_t));
+  if (write(client.req_pipe, version_request, sizeof(version_request)) == -1 ||
+      read_full(client.resp_pipe, &version, sizeof(uint32_t))) {
+    fprintf(stderr, "Failed to negotiate the protocol version\n");
+    return 1;
+  }
+  if (version != PROTOCOL_VERSION) {
+    fprintf(stderr, "Server does not speak protocol v%d\n", PROTOCOL_VERSION);
+    return 1;
+  }
+
+  client.next_request_id = 0;
+  client.pending_head = 0;
+  client.num_pending = 0;
+  reader_init(&client.responses, client.resp_pipe);
   return 0;
 }
 
-int ems_quit(void) { 
-  char OP_CODE = '2';
-  ssize_t ret_write = write(client.req_pipe, &OP_CODE, sizeof(char));
-  if (ret_write < 0) {
-      fprintf(stderr, "[ERR]: write failed: %s\n", strerror(errno));
+int ems_quit(void) {
+  uint32_t request_id;
+  if (send_request(OP_QUIT, NULL, 0, &request_id)) {
       exit(EXIT_FAILURE);
   }
   close (client.req_pipe);
@@ -90,166 +196,277 @@ int ems_quit(void) {
   return 1;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  char OP_CODE = '3';
-
-  char message[sizeof(char) + sizeof(int) + sizeof(unsigned int) + 2 * sizeof(size_t)];
-  char *ptr = message; 
+/// Checks that sizes and coordinates fit the fields of a request, which are 32 bits wide on the wire.
+/// @param values Array of values to check.
+/// @param count Number of values.
+/// @return 0 if every value fits, 1 otherwise.
+static int check_fields(const size_t* values, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (values[i] > UINT32_MAX) {
+      fprintf(stderr, "Value %zu does not fit in a request\n", values[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  memcpy(ptr, &OP_CODE, sizeof(char));
-  ptr += sizeof(char);
-  memcpy(ptr, &client.session_id, sizeof(int));
-  ptr += sizeof(int);
-  memcpy(ptr, &event_id, sizeof(unsigned int));
-  ptr += sizeof(unsigned int);
-  memcpy(ptr, &num_rows, sizeof(size_t));
-  ptr += sizeof(size_t);
-  memcpy(ptr, &num_cols, sizeof(size_t));
-
-  ssize_t ret_write = write(client.req_pipe, message, sizeof(message));
-  if (ret_write == -1) {
-    fprintf(stderr, "Failed to write\n");
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (check_fields((size_t[]){num_rows, num_cols}, 2)) {
     return 1;
   }
-
+  uint32_t fields[3] = {event_id, (uint32_t)num_rows, (uint32_t)num_cols};
+  uint32_t request_id;
   int ret_value;
-  ssize_t ret_read = read(client.resp_pipe, &ret_value, sizeof(int));
-  if (ret_read == -1) {
-    fprintf(stderr, "Failed to read\n");
+  if (send_sync_request(OP_CREATE, fields, 3, &request_id) || read_response(OP_CREATE, request_id, &ret_value)) {
     return 1;
   }
   return ret_value;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  char OP_CODE = '4';
-  char message[sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t) + 2 * num_seats * sizeof(size_t)];
-  char *ptr = message;
+/// Packs the fields of a RESERVE.
+/// @param fields Array of 2 + 2 * MAX_RESERVATION_SIZE fields to fill.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve, at most MAX_RESERVATION_SIZE.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the fields were packed, 1 if a coordinate does not fit in them.
+static int pack_reserve(uint32_t* fields, unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (check_fields(xs, num_seats) || check_fields(ys, num_seats)) {
+    return 1;
+  }
+  fields[0] = event_id;
+  fields[1] = (uint32_t)num_seats;
+  for (size_t i = 0; i < num_seats; i++) {
+    fields[2 + i] = (uint32_t)xs[i];
+    fields[2 + num_seats + i] = (uint32_t)ys[i];
+  }
+  return 0;
+}
 
-  memcpy(ptr, &OP_CODE, sizeof(char));
-  ptr += sizeof(char);
-  memcpy(ptr, &client.session_id, sizeof(int));
-  ptr += sizeof(int);
-  memcpy(ptr, &event_id, sizeof(unsigned int));
-  ptr += sizeof(unsigned int);
-  memcpy(ptr, &num_seats, sizeof(size_t));
-  ptr += sizeof(size_t);
-  memcpy(ptr, xs, num_seats * sizeof(size_t));
-  ptr += num_seats * sizeof(size_t);
-  memcpy(ptr, ys, num_seats * sizeof(size_t));
-
-  ssize_t ret_write = write(client.req_pipe, message, sizeof(message));
-  if (ret_write == -1) {
-    fprintf(stderr, "Failed to write\n");
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  uint32_t fields[2 + 2 * MAX_RESERVATION_SIZE];
+  if (num_seats > MAX_RESERVATION_SIZE || pack_reserve(fields, event_id, num_seats, xs, ys)) {
     return 1;
   }
-  
+
+  uint32_t request_id;
   int ret_value;
-  ssize_t ret_read = read(client.resp_pipe, &ret_value, sizeof(int));
-  if (ret_read == -1) {
-    fprintf(stderr, "Failed to read\n");
+  if (send_sync_request(OP_RESERVE, fields, 2 + 2 * num_seats, &request_id) ||
+      read_response(OP_RESERVE, request_id, &ret_value)) {
     return 1;
   }
   return ret_value;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  char OP_CODE = '5';
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols, uint32_t* request_id) {
+  if (check_fields((size_t[]){num_rows, num_cols}, 2)) {
+    return 1;
+  }
+  uint32_t fields[3] = {event_id, (uint32_t)num_rows, (uint32_t)num_cols};
+  return send_async_request(OP_CREATE, fields, 3, request_id);
+}
 
-  char message[sizeof(char) + sizeof(int) + sizeof(unsigned int)];
-  char *ptr = message;
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys, uint32_t* request_id) {
+  uint32_t fields[2 + 2 * MAX_RESERVATION_SIZE];
+  if (num_seats > MAX_RESERVATION_SIZE || pack_reserve(fields, event_id, num_seats, xs, ys)) {
+    return 1;
+  }
+  return send_async_request(OP_RESERVE, fields, 2 + 2 * num_seats, request_id);
+}
 
-  memcpy(ptr, &OP_CODE, sizeof(char));
-  ptr += sizeof(char);
-  memcpy(ptr, &client.session_id, sizeof(int));
-  ptr += sizeof(int);
-  memcpy(ptr, &event_id, sizeof(unsigned int));
-  
-  ssize_t ret_write = write(client.req_pipe, message, sizeof(message));
-  if (ret_write == -1) {
-    fprintf(stderr, "Failed to write\n");
+size_t ems_in_flight(void) { return client.num_pending; }
+
+int ems_poll(struct EmsCompletion* completion) {
+  if (client.num_pending == 0) {
+    return 0;
+  }
+
+  // A reply is written whole, so once any of it is buffered or readable the rest follows right away
+  if (client.responses.start == client.responses.end) {
+    struct pollfd pfd = {client.resp_pipe, POLLIN, 0};
+    int ready = poll(&pfd, 1, 0);
+    if (ready == -1) {
+      return errno == EINTR ? 0 : -1;
+    }
+    if (ready == 0) {
+      return 0;
+    }
+  }
+  return ems_wait(completion) == 0 ? 1 : -1;
+}
+
+int ems_wait(struct EmsCompletion* completion) {
+  if (client.num_pending == 0) {
     return 1;
   }
 
+  struct PendingRequest* oldest = &client.pending[client.pending_head];
+  completion->request_id = oldest->request_id;
+  completion->opcode = oldest->opcode;
+  if (read_response(oldest->opcode, oldest->request_id, &completion->result)) {
+    return 1;
+  }
+
+  client.pending_head = (client.pending_head + 1) % ASYNC_MAX_IN_FLIGHT;
+  client.num_pending--;
+  return 0;
+}
+
+/// Reads the response to a SHOW and prints the event to the given file.
+/// @param out_fd File descriptor to print the event to.
+/// @param request_id Id of the request the SHOW was answered for.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int read_show(int out_fd, uint32_t request_id) {
   int ret_value;
-  ssize_t ret_read = read(client.resp_pipe, &ret_value, sizeof(int));
-  if (ret_read == -1) {
-    fprintf(stderr, "Failed to read\n");
+  if (read_response(OP_SHOW, request_id, &ret_value)) {
     return 1;
   }
 
   if (ret_value == 0) {
-    size_t num_rows, num_cols;
-
-    ret_read = read(client.resp_pipe, &num_rows, sizeof(size_t));
-    if (ret_read == -1) {
-      fprintf(stderr, "Failed to read num_rows\n");
-      return 1;
-    }
-    ret_read = read(client.resp_pipe, &num_cols, sizeof(size_t));
-    if (ret_read == -1) {
-      fprintf(stderr, "Failed to read num_cols\n");
+    uint32_t dims[2];
+    if (read_fields(dims, 2)) {
+      fprintf(stderr, "Failed to read the event size\n");
       return 1;
     }
+    size_t num_rows = dims[0], num_cols = dims[1];
 
-    unsigned int seats[num_rows * num_cols];
-    ret_read = read(client.resp_pipe, seats, sizeof(unsigned int) * num_rows * num_cols);
-    if (ret_read == -1) {
-      fprintf(stderr, "Failed to read seats data\n");
+    // Rows are read and printed a band at a time, so large events do not need the whole seat map in memory
+    size_t band_rows = num_rows < SEAT_TILE_ROWS ? num_rows : SEAT_TILE_ROWS;
+    unsigned int* seats = malloc(band_rows * num_cols * sizeof(unsigned int));
+    if (seats == NULL) {
+      fprintf(stderr, "Failed to allocate memory for seats data\n");
       return 1;
     }
 
-    for (size_t i = 1; i <= num_rows; i++) {
-      for (size_t j = 1; j <= num_cols; j++) {
-        char buffer[16];
-        sprintf(buffer, "%u", seats[seat_index(num_cols, i, j)]);
-
-        if (print_str(out_fd, buffer)) {
-          fprintf(stderr, "Error writing to file descriptor\n");
-          return 1;
-        }
-
-        if (j < num_cols) {
-          if (print_str(out_fd, " ")) {
-            fprintf(stderr, "Error writing to file descriptor\n");
-            return 1;
-          }
-        }
+    for (size_t row = 1; row <= num_rows; row += band_rows) {
+      size_t count = num_rows - row + 1 < band_rows ? num_rows - row + 1 : band_rows;
+      if (read_fields(seats, count * num_cols)) {
+        fprintf(stderr, "Failed to read seats data\n");
+        free(seats);
+        return 1;
       }
 
-      if (print_str(out_fd, "\n")) {
+      if (print_seats(out_fd, seats, count, num_cols)) {
         fprintf(stderr, "Error writing to file descriptor\n");
+        free(seats);
         return 1;
       }
     }
+    free(seats);
     return 0;
   } else {
     return 1;
   }
 }
 
-int ems_list_events(int out_fd) {
-  char OP_CODE = '6';
+int ems_batch(const struct BatchOp* ops, size_t num_ops, int* results, int out_fd) {
+  // Largest payload the server accepts in a frame
+  uint32_t fields[(FRAME_BUFFER_SIZE - sizeof(struct FrameHeader)) / sizeof(uint32_t)];
+  size_t max_fields = sizeof(fields) / sizeof(uint32_t);
+  if (num_ops == 0 || num_ops > MAX_BATCH_SIZE) {
+    return 1;
+  }
+
+  size_t num_fields = 0;
+  fields[num_fields++] = (uint32_t)num_ops;
+  for (size_t i = 0; i < num_ops; i++) {
+    const struct BatchOp* op = &ops[i];
+    size_t op_fields = op->opcode == OP_CREATE ? 4 : op->opcode == OP_SHOW ? 2 : 3 + 2 * op->num_seats;
+    if ((op->opcode != OP_CREATE && op->opcode != OP_RESERVE && op->opcode != OP_SHOW) ||
+        op_fields > max_fields - num_fields) {
+      fprintf(stderr, "Batch too large or with an operation it cannot carry\n");
+      return 1;
+    }
 
-  ssize_t ret_write = write(client.req_pipe, &OP_CODE, sizeof(char));
-  ret_write = write(client.req_pipe, &client.session_id, sizeof(int));
-  if (ret_write == -1) {
-    fprintf(stderr, "Failed to write OP_CODE\n");
+    if (op->opcode == OP_CREATE && check_fields((size_t[]){op->num_rows, op->num_cols}, 2)) {
+      return 1;
+    }
+    if (op->opcode == OP_RESERVE && (check_fields(op->xs, op->num_seats) || check_fields(op->ys, op->num_seats))) {
+      return 1;
+    }
+
+    fields[num_fields++] = op->opcode;
+    fields[num_fields++] = op->event_id;
+    if (op->opcode == OP_CREATE) {
+      fields[num_fields++] = (uint32_t)op->num_rows;
+      fields[num_fields++] = (uint32_t)op->num_cols;
+    } else if (op->opcode == OP_RESERVE) {
+      fields[num_fields++] = (uint32_t)op->num_seats;
+      for (size_t j = 0; j < op->num_seats; j++) {
+        fields[num_fields + j] = (uint32_t)op->xs[j];
+        fields[num_fields + op->num_seats + j] = (uint32_t)op->ys[j];
+      }
+      num_fields += 2 * op->num_seats;
+    }
+  }
+
+  uint32_t request_id;
+  int result;
+  if (send_sync_request(OP_BATCH, fields, num_fields, &request_id) || read_response(OP_BATCH, request_id, &result)) {
+    return 1;
+  }
+  if (result == 0 && read_fields(results, num_ops)) {
+    fprintf(stderr, "Failed to read\n");
+    return 1;
+  }
+
+  // The events shown follow, each answered like a SHOW of its own
+  for (size_t i = 0; result == 0 && i < num_ops; i++) {
+    if (ops[i].opcode == OP_SHOW && read_show(out_fd, request_id) && results[i] == 0) {
+      results[i] = 1;
+    }
+  }
+  return result;
+}
+
+int ems_reserve_best(unsigned int event_id, size_t num_seats, int contiguous, size_t* xs, size_t* ys,
+                     unsigned int* reservation_id) {
+  if (check_fields(&num_seats, 1)) {
+    return 1;
+  }
+  uint32_t fields[3] = {event_id, (uint32_t)num_seats, (uint32_t)contiguous};
+  uint32_t request_id;
+  int ret_value;
+  if (send_sync_request(OP_RESERVE_BEST, fields, 3, &request_id) ||
+      read_response(OP_RESERVE_BEST, request_id, &ret_value)) {
     return 1;
   }
 
+  if (ret_value == 0) {
+    uint32_t picked[2 + 2 * MAX_RESERVATION_SIZE];
+    if (read_fields(picked, 2) || picked[1] != num_seats || num_seats > MAX_RESERVATION_SIZE ||
+        read_fields(picked + 2, 2 * num_seats)) {
+      fprintf(stderr, "Failed to read the reserved seats\n");
+      return 1;
+    }
+
+    *reservation_id = picked[0];
+    for (size_t i = 0; i < num_seats; i++) {
+      xs[i] = picked[2 + i];
+      ys[i] = picked[2 + num_seats + i];
+    }
+  }
+  return ret_value;
+}
 
+int ems_show(int out_fd, unsigned int event_id) {
+  uint32_t request_id;
+  if (send_sync_request(OP_SHOW, &event_id, 1, &request_id)) {
+    return 1;
+  }
+  return read_show(out_fd, request_id);
+}
+
+int ems_list_events(int out_fd) {
+  uint32_t request_id;
   int ret_value;
-  ssize_t ret_read = read(client.resp_pipe, &ret_value, sizeof(int));
-  if (ret_read == -1) {
-    fprintf(stderr, "Failed to read ret_value\n");
+  if (send_sync_request(OP_LIST, NULL, 0, &request_id) || read_response(OP_LIST, request_id, &ret_value)) {
     return 1;
   }
 
   if (ret_value == 0) {
-    size_t num_events;
-    ret_read = read(client.resp_pipe, &num_events, sizeof(size_t));
-    if (ret_read == -1) {
+    uint32_t num_events;
+    if (read_fields(&num_events, 1)) {
       fprintf(stderr, "Failed to read num_events\n");
       return 1;
     }
@@ -261,23 +478,23 @@ int ems_list_events(int out_fd) {
       return 0;
     }
 
-    unsigned int ids[num_events];
-    ret_read = read(client.resp_pipe, ids, num_events * sizeof(unsigned int));
-    
-    int i = 0;
-    while (num_events > 0) {
-      if (print_str(out_fd, "Event: ")) {
-        fprintf(stderr, "Error writing to file descriptor\n");
+    for (uint32_t i = 0; i < num_events; i++) {
+      uint32_t id;
+      if (read_fields(&id, 1)) {
+        fprintf(stderr, "Failed to read the event ids\n");
         return 1;
       }
-      char id[16];
-      sprintf(id, "%d\n", ids[i]);
-      if (print_str(out_fd, id)) {
+
+      // Each line is formatted whole and written at once
+      char line[sizeof("Event: ") - 1 + UINT_TEXT_MAX + 1];
+      size_t len = sizeof("Event: ") - 1;
+      memcpy(line, "Event: ", len);
+      len += format_uint(line + len, id);
+      line[len++] = '\n';
+      if (write(out_fd, line, len) == -1) {
         fprintf(stderr, "Error writing to file descriptor\n");
         return 1;
       }
-      i++;
-      num_events--;
     }
     return 0;
 
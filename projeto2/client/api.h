@@ -2,7 +2,23 @@
 #define CLIENT_API_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/protocol.h"
+
+/// Request sent without waiting for its result.
+struct PendingRequest {
+  uint32_t request_id;  // Id the request was sent with
+  uint32_t opcode;      // Op code of the request
+};
+
+/// Result of a request sent without waiting for it.
+struct EmsCompletion {
+  uint32_t request_id;  // Id the request was sent with
+  uint32_t opcode;      // OP_CREATE or OP_RESERVE
+  int result;           // 0 if the request succeeded, 1 otherwise
+};
 
 typedef struct {
   int req_pipe;
@@ -10,6 +26,11 @@ typedef struct {
   int session_id;
   char resp_pipe_path[MAX_PIPE_NAME_SIZE + 1];
   char req_pipe_path[MAX_PIPE_NAME_SIZE + 1];
+  uint32_t next_request_id;  // Id given to the next request
+  struct Reader responses;   // Responses read ahead from resp_pipe
+  struct PendingRequest pending[ASYNC_MAX_IN_FLIGHT];  // Requests whose results were not taken, oldest first
+  size_t pending_head;                                 // Index of the oldest pending request
+  size_t num_pending;                                  // Number of pending requests
 } Client; 
 
 /// Connects to an EMS server.
@@ -38,6 +59,61 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Sends a CREATE without waiting for its result, which is taken later with ems_poll or ems_wait.
+/// @note At most ASYNC_MAX_IN_FLIGHT requests may be waiting for their results, and the calls that wait
+/// for their own result fail until every one of them is taken.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @param request_id Pointer to the variable to store the id of the request in.
+/// @return 0 if the request was sent, 1 otherwise.
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols, uint32_t* request_id);
+
+/// Sends a RESERVE without waiting for its result, which is taken later with ems_poll or ems_wait.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param request_id Pointer to the variable to store the id of the request in.
+/// @return 0 if the request was sent, 1 otherwise.
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys, uint32_t* request_id);
+
+/// Gets the number of requests whose results were not taken yet.
+/// @return Number of requests in flight.
+size_t ems_in_flight(void);
+
+/// Takes the result of the oldest request in flight if it already arrived, without blocking.
+/// @param completion Pointer to the variable to store the result in.
+/// @return 1 if a result was taken, 0 if it did not arrive yet or nothing is in flight, -1 on error.
+int ems_poll(struct EmsCompletion* completion);
+
+/// Waits for the result of the oldest request in flight. The server answers a session in order.
+/// @param completion Pointer to the variable to store the result in.
+/// @return 0 if a result was taken, 1 on error or if nothing is in flight.
+int ems_wait(struct EmsCompletion* completion);
+
+/// Runs several CREATE, RESERVE and SHOW requests with a single request, each with its own result. The server
+/// looks up and locks each event they touch once for the whole batch.
+/// @note Requests on the same event run in the order given, those on different events in any order. A SHOW sees
+/// the requests before it on its event, and the events shown are printed in the order given.
+/// @param ops Array of the requests to run, at most MAX_BATCH_SIZE.
+/// @param num_ops Number of requests.
+/// @param results Array to store the result of each request in, 0 if it succeeded, 1 otherwise.
+/// @param out_fd File descriptor to print the events shown to.
+/// @return 0 if the batch was run, 1 otherwise.
+int ems_batch(const struct BatchOp* ops, size_t num_ops, int* results, int out_fd);
+
+/// Creates a new reservation on the best seats the server finds available.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param contiguous Whether the seats must be side by side in a single row.
+/// @param xs Array to store the rows of the reserved seats in.
+/// @param ys Array to store the columns of the reserved seats in.
+/// @param reservation_id Pointer to the variable to store the reservation id in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats, int contiguous, size_t* xs, size_t* ys,
+                     unsigned int* reservation_id);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
@@ -5,8 +5,176 @@
 
 #include "api.h"
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/protocol.h"
 #include "parser.h"
 
+/// Prints the seats picked for a reservation, in the same format RESERVE takes them.
+/// @param out_fd File descriptor to print to.
+/// @param reservation_id Id of the reservation.
+/// @param num_seats Number of seats reserved.
+/// @param xs Array of rows of the reserved seats.
+/// @param ys Array of columns of the reserved seats.
+/// @return 0 if the reservation was printed successfully, 1 otherwise.
+static int print_reservation(int out_fd, unsigned int reservation_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (print_str(out_fd, "Reservation ") || print_uint(out_fd, reservation_id) || print_str(out_fd, ": [")) return 1;
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (print_str(out_fd, i == 0 ? "(" : " (") || print_uint(out_fd, (unsigned int)xs[i]) || print_str(out_fd, ",") ||
+        print_uint(out_fd, (unsigned int)ys[i]) || print_str(out_fd, ")")) {
+      return 1;
+    }
+  }
+
+  return print_str(out_fd, "]\n");
+}
+
+/// Reports a request that was sent without waiting for it, if it failed.
+/// @param completion Result of the request.
+static void report(const struct EmsCompletion* completion) {
+  if (completion->result == 0) return;
+  fprintf(stderr, completion->opcode == OP_CREATE ? "Failed to create event\n" : "Failed to reserve seats\n");
+}
+
+/// Waits for the results of requests in flight until at most max_in_flight are left.
+/// @param max_in_flight Number of requests that may stay in flight.
+/// @return 0 if the results were taken successfully, 1 otherwise.
+static int drain(size_t max_in_flight) {
+  while (ems_in_flight() > max_in_flight) {
+    struct EmsCompletion completion;
+    if (ems_wait(&completion)) return 1;
+    report(&completion);
+  }
+  return 0;
+}
+
+/// Gets how many requests may stay in flight when a command starts.
+/// @param command The command about to run.
+/// @return Number of requests whose results may still be left untaken.
+static size_t max_in_flight(enum Command command) {
+  switch (command) {
+    case CMD_CREATE:
+    case CMD_RESERVE:
+      return ASYNC_MAX_IN_FLIGHT - 1;
+
+    // Their output or timing depends on the requests before them
+    case CMD_RESERVE_BEST:
+    case CMD_SHOW:
+    case CMD_LIST_EVENTS:
+    case CMD_WAIT:
+    case EOC:
+      return 0;
+
+    // A batch waits right before its own request is sent, the others send nothing
+    case CMD_BATCH:
+    case CMD_HELP:
+    case CMD_END:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+      break;
+  }
+  return ASYNC_MAX_IN_FLIGHT;
+}
+
+/// Sends the operations collected for a batch and reports those that failed.
+/// @param ops Array of operations to send.
+/// @param num_ops Number of operations.
+/// @param out_fd File descriptor to print the events shown to.
+static void send_batch(const struct BatchOp* ops, size_t num_ops, int out_fd) {
+  int results[MAX_BATCH_SIZE];
+  if (num_ops == 0) return;
+
+  if (drain(0)) {
+    fprintf(stderr, "Failed to get results\n");
+  }
+  if (ems_batch(ops, num_ops, results, out_fd)) {
+    fprintf(stderr, "Failed to run batch\n");
+    return;
+  }
+  for (size_t i = 0; i < num_ops; i++) {
+    if (results[i] == 0) continue;
+    fprintf(stderr, ops[i].opcode == OP_CREATE    ? "Failed to create event\n"
+                    : ops[i].opcode == OP_RESERVE ? "Failed to reserve seats\n"
+                                                  : "Failed to show event\n");
+  }
+}
+
+/// Runs the CREATE, RESERVE and SHOW commands of a BATCH block, up to its END, with as few requests as possible.
+/// @param in Reader positioned right after the BATCH line.
+/// @param out_fd File descriptor to print the events shown to.
+static void run_batch(struct Reader* in, int out_fd) {
+  // Seats of every operation of a batch, too large for the stack
+  static size_t xs[MAX_BATCH_SIZE][MAX_RESERVATION_SIZE], ys[MAX_BATCH_SIZE][MAX_RESERVATION_SIZE];
+  struct BatchOp ops[MAX_BATCH_SIZE];
+  size_t num_ops = 0;
+
+  while (1) {
+    enum Command command = get_next(in);
+    if (command == CMD_END || command == EOC) break;
+
+    if (num_ops == MAX_BATCH_SIZE) {
+      send_batch(ops, num_ops, out_fd);
+      num_ops = 0;
+    }
+
+    struct BatchOp* op = &ops[num_ops];
+    switch (command) {
+      case CMD_CREATE:
+        if (parse_create(in, &op->event_id, &op->num_rows, &op->num_cols) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          break;
+        }
+        op->opcode = OP_CREATE;
+        num_ops++;
+        break;
+
+      case CMD_RESERVE:
+        op->num_seats = parse_reserve(in, MAX_RESERVATION_SIZE, &op->event_id, xs[num_ops], ys[num_ops]);
+        if (op->num_seats == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          break;
+        }
+        op->opcode = OP_RESERVE;
+        op->xs = xs[num_ops];
+        op->ys = ys[num_ops];
+        num_ops++;
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(in, &op->event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          break;
+        }
+        op->opcode = OP_SHOW;
+        num_ops++;
+        break;
+
+      case CMD_RESERVE_BEST:
+      case CMD_WAIT:
+        skip_line(in);
+        fprintf(stderr, "Only CREATE, RESERVE and SHOW can be batched\n");
+        break;
+
+      case CMD_LIST_EVENTS:
+      case CMD_HELP:
+      case CMD_BATCH:
+        fprintf(stderr, "Only CREATE, RESERVE and SHOW can be batched\n");
+        break;
+
+      case CMD_INVALID:
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        break;
+
+      case CMD_EMPTY:
+      case CMD_END:
+      case EOC:
+        break;
+    }
+  }
+
+  send_batch(ops, num_ops, out_fd);
+}
+
 int main(int argc, char* argv[]) {
   if (argc < 5) {
     fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
@@ -47,33 +215,57 @@ int main(int argc, char* argv[]) {
     ems_quit();
     return 1;
   }
-  
+
+  struct Reader in;
+  reader_init(&in, in_fd);
+
   while (1) {
     unsigned int event_id;
     size_t num_rows, num_columns, num_coords;
-    unsigned int delay = 0;
+    unsigned int delay = 0, reservation_id;
+    int contiguous;
     size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    uint32_t request_id;
+
+    // CREATE and RESERVE only print on failure, so they are sent without waiting for their results, which are
+    // taken before any command whose output or timing depends on them
+    enum Command command = get_next(&in);
+    if (drain(max_in_flight(command))) {
+      fprintf(stderr, "Failed to get results\n");
+    }
 
-    switch (get_next(in_fd)) {
+    switch (command) {
       case CMD_CREATE:
-        if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
+        if (parse_create(&in, &event_id, &num_rows, &num_columns) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
-        if (ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
+        if (ems_create_async(event_id, num_rows, num_columns, &request_id)) fprintf(stderr, "Failed to create event\n");
         break;
 
       case CMD_RESERVE:
-        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        num_coords = parse_reserve(&in, MAX_RESERVATION_SIZE, &event_id, xs, ys);
         if (num_coords == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        if (ems_reserve_async(event_id, num_coords, xs, ys, &request_id)) fprintf(stderr, "Failed to reserve seats\n");
+        break;
+
+      case CMD_RESERVE_BEST:
+        if (parse_reserve_best(&in, &event_id, &num_coords, &contiguous) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+        if (ems_reserve_best(event_id, num_coords, contiguous, xs, ys, &reservation_id)) {
+          fprintf(stderr, "Failed to reserve seats\n");
+          break;
+        }
+        if (print_reservation(out_fd, reservation_id, num_coords, xs, ys)) fprintf(stderr, "Failed to write\n");
         break;
 
       case CMD_SHOW:
-        if (parse_show(in_fd, &event_id) != 0) {
+        if (parse_show(&in, &event_id) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
@@ -86,7 +278,7 @@ int main(int argc, char* argv[]) {
         break;
 
       case CMD_WAIT:
-        if (parse_wait(in_fd, &delay, NULL) == -1) {
+        if (parse_wait(&in, &delay, NULL) == -1) {
             fprintf(stderr, "Invalid command. See HELP for usage\n");
             continue;
         }
@@ -97,6 +289,11 @@ int main(int argc, char* argv[]) {
         }
         break;
 
+      case CMD_BATCH:
+        run_batch(&in, out_fd);
+        break;
+
+      case CMD_END:
       case CMD_INVALID:
         fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
@@ -106,9 +303,11 @@ int main(int argc, char* argv[]) {
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  RESERVE_BEST <event_id> <num_seats> [contiguous]\n"
             "  SHOW <event_id>\n"
             "  LIST\n"
             "  WAIT <delay_ms>\n"
+            "  BATCH, then CREATE, RESERVE and SHOW commands, then END\n"
             "  HELP\n");
 
         break;
@@ -3,3 +3,29 @@
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 8
 #define MAX_PIPE_NAME_SIZE 40
+#define EVENT_SHARD_COUNT 16
+#define EVENT_CACHE_SIZE 4
+#define STRIPE_ROWS 16                  // Rows covered by each lock stripe of an event
+#define STRIPE_MIN_SEATS 65536          // Events at least this large are striped from creation
+#define STRIPE_CONTENTION_THRESHOLD 32  // Contended locks before an event turns striped
+#define SEAT_TILE_ROWS 16               // Rows of each seat map tile, allocated on the first reservation in it
+#define SEAT_TILE_COLS 64               // Columns of each seat map tile
+#define EPOCH_RETIRE_BATCH 32           // Pointers a thread retires before handing them to the reclaimer
+#define SLAB_SIZE 65536                 // Bytes the slab allocator carves into objects at a time
+#define SLAB_MAX_OBJECT 65536           // Largest object served from slabs, larger ones go straight to malloc
+#define SLAB_CACHE_BATCH 16             // Objects a thread moves between its cache and the shared free lists at once
+#define READER_BUFFER_SIZE 8192         // Bytes the parsers read from a .jobs file at a time
+#define RENDER_BUFFER_SIZE 16384        // Bytes of seat map text formatted before each write
+#define FRAME_BUFFER_SIZE 65536         // Bytes of requests a session reads ahead, the largest frame it accepts
+#define OUTBOX_FLUSH_SIZE 16384         // Bytes of answers a session queues before writing them
+#define ASYNC_MAX_IN_FLIGHT 128         // Requests a client may send before reading their results
+#define MAX_BATCH_SIZE 64               // Operations a single BATCH request may carry
+
+// Serves every session from a few threads waiting on epoll instead of a thread per session, built with EVENT_LOOP=1
+#ifndef EVENT_LOOP
+#define EVENT_LOOP 0
+#endif
+#define EVENT_LOOP_THREADS 2          // Threads serving the sessions of the event loop
+#define EVENT_LOOP_MAX_SESSIONS 4096  // Sessions the event loop keeps open at once
+#define EVENT_LOOP_BATCH 16           // Ready sessions a thread takes from epoll at a time
+#define EVENT_LOOP_OPEN_TIMEOUT 10    // Seconds a client has to open its pipes, checked every as many seconds
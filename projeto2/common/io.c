@@ -1,35 +1,87 @@
 #include "io.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-int parse_uint(int fd, unsigned int *value, char *next) {
-  char buf[16];
+void reader_init(struct Reader *reader, int fd) {
+  reader->fd = fd;
+  reader->start = 0;
+  reader->end = 0;
+}
+
+/// Refills the buffer of a reader that has handed out all its characters.
+/// @param reader The reader to refill.
+/// @return 1 if characters were read, 0 at the end of the file, -1 on error.
+static int reader_fill(struct Reader *reader) {
+  ssize_t read_bytes;
+  do {
+    read_bytes = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+  } while (read_bytes == -1 && errno == EINTR);
+
+  if (read_bytes <= 0) {
+    return read_bytes == 0 ? 0 : -1;
+  }
+
+  reader->start = 0;
+  reader->end = (size_t)read_bytes;
+  return 1;
+}
+
+int reader_getc(struct Reader *reader, char *ch) {
+  if (reader->start == reader->end) {
+    int ret = reader_fill(reader);
+    if (ret != 1) {
+      return ret;
+    }
+  }
+
+  *ch = reader->buffer[reader->start++];
+  return 1;
+}
+
+size_t reader_read(struct Reader *reader, char *buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    if (reader->start == reader->end && reader_fill(reader) != 1) {
+      break;
+    }
+
+    size_t available = reader->end - reader->start;
+    size_t chunk = count - done < available ? count - done : available;
+    memcpy(buf + done, reader->buffer + reader->start, chunk);
+    reader->start += chunk;
+    done += chunk;
+  }
+
+  return done;
+}
+
+int parse_uint(struct Reader *reader, unsigned int *value, char *next) {
+  unsigned long ul = 0;
 
-  int i = 0;
   while (1) {
-    ssize_t read_bytes = read(fd, buf + i, 1);
-    if (read_bytes == -1) {
+    int ret = reader_getc(reader, next);
+    if (ret == -1) {
       return 1;
-    } else if (read_bytes == 0) {
+    } else if (ret == 0) {
       *next = '\0';
       break;
     }
 
-    *next = buf[i];
-
-    if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
+    if (*next > '9' || *next < '0') {
       break;
     }
 
-    i++;
+    // Saturate just above UINT_MAX, so overly long numbers are still consumed and rejected
+    ul = ul * 10 + (unsigned long)(*next - '0');
+    if (ul > UINT_MAX) {
+      ul = (unsigned long)UINT_MAX + 1;
+    }
   }
 
-  unsigned long ul = strtoul(buf, NULL, 10);
-
   if (ul > UINT_MAX) {
     return 1;
   }
@@ -39,41 +91,82 @@ int parse_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-int print_uint(int fd, unsigned int value) {
-  char buffer[16];
-  size_t i = 16;
-
-  for (; value > 0; value /= 10) {
-    buffer[--i] = '0' + (char)(value % 10);
-  }
-
-  if (i == 16) {
-    buffer[--i] = '0';
-  }
-
-  while (i < 16) {
-    ssize_t written = write(fd, buffer + i, 16 - i);
+/// Two digits for every number below 100, so integers are formatted with one division per pair of digits.
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Writes every byte of a buffer, resuming after partial writes.
+/// @param fd The file descriptor to write to.
+/// @param buf The bytes to write.
+/// @param len The number of bytes.
+/// @return 0 if the bytes were written successfully, 1 otherwise.
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
     if (written == -1) {
+      if (errno == EINTR) continue;
       return 1;
     }
 
-    i += (size_t)written;
+    buf += (size_t)written;
+    len -= (size_t)written;
   }
 
   return 0;
 }
 
-int print_str(int fd, const char *str) {
-  size_t len = strlen(str);
-  while (len > 0) {
-    ssize_t written = write(fd, str, len);
-    if (written == -1) {
-      return 1;
-    }
+size_t format_uint(char *buf, unsigned int value) {
+  size_t len = 1;
+  for (unsigned int rest = value; rest >= 10; rest /= 10) {
+    len++;
+  }
 
-    str += (size_t)written;
-    len -= (size_t)written;
+  // Digits are placed from the last one, a pair at a time
+  char *end = buf + len;
+  while (value >= 100) {
+    unsigned int pair = value % 100;
+    value /= 100;
+    *--end = digit_pairs[2 * pair + 1];
+    *--end = digit_pairs[2 * pair];
+  }
+  if (value >= 10) {
+    *--end = digit_pairs[2 * value + 1];
+    *--end = digit_pairs[2 * value];
+  } else {
+    *--end = (char)('0' + value);
   }
 
-  return 0;
+  return len;
+}
+
+int print_uint(int fd, unsigned int value) {
+  char buffer[UINT_TEXT_MAX];
+  return write_all(fd, buffer, format_uint(buffer, value));
 }
+
+int print_seats(int fd, const unsigned int *seats, size_t rows, size_t cols) {
+  char buffer[RENDER_BUFFER_SIZE];
+  size_t used = 0;
+
+  for (size_t i = 0; i < rows; i++) {
+    const unsigned int *row = seats + i * cols;
+    for (size_t j = 0; j < cols; j++) {
+      // Room for the longest seat and the separator after it
+      if (RENDER_BUFFER_SIZE - used < UINT_TEXT_MAX + 1) {
+        if (write_all(fd, buffer, used)) {
+          return 1;
+        }
+        used = 0;
+      }
+
+      used += format_uint(buffer + used, row[j]);
+      buffer[used++] = j + 1 < cols ? ' ' : '\n';
+    }
+  }
+
+  return write_all(fd, buffer, used);
+}
+
+int print_str(int fd, const char *str) { return write_all(fd, str, strlen(str)); }
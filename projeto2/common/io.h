@@ -1,12 +1,45 @@
 #ifndef COMMON_IO_H
 #define COMMON_IO_H
 
-/// Parses an unsigned integer from the given file descriptor.
+#include <stddef.h>
+
+#include "common/constants.h"
+
+#define UINT_TEXT_MAX 10  // Digits of the largest unsigned int
+
+/// Buffered reader over a file descriptor, so the parsers can take one character at a time
+/// without a read syscall for each of them.
+struct Reader {
+  int fd;                           // File descriptor to read from
+  size_t start;                     // Index of the next character to hand out
+  size_t end;                       // Number of characters in the buffer
+  char buffer[READER_BUFFER_SIZE];  // Characters read ahead from fd
+};
+
+/// Initializes a reader with an empty buffer.
+/// @param reader The reader to initialize.
 /// @param fd The file descriptor to read from.
+void reader_init(struct Reader *reader, int fd);
+
+/// Reads the next character.
+/// @param reader The reader to read from.
+/// @param ch Pointer to the variable to store the character in.
+/// @return 1 if a character was read, 0 at the end of the file, -1 on error.
+int reader_getc(struct Reader *reader, char *ch);
+
+/// Reads up to count characters, stopping early only at the end of the file or on error.
+/// @param reader The reader to read from.
+/// @param buf The buffer to store the characters in.
+/// @param count The number of characters to read.
+/// @return The number of characters read.
+size_t reader_read(struct Reader *reader, char *buf, size_t count);
+
+/// Parses an unsigned integer from the given reader.
+/// @param reader The reader to read from.
 /// @param value Pointer to the variable to store the value in.
 /// @param next Pointer to the variable to store the next character in.
 /// @return 0 if the integer was read successfully, 1 otherwise.
-int parse_uint(int fd, unsigned int *value, char *next);
+int parse_uint(struct Reader *reader, unsigned int *value, char *next);
 
 /// Prints an unsigned integer to the given file descriptor.
 /// @param fd The file descriptor to write to.
@@ -14,6 +47,22 @@ int parse_uint(int fd, unsigned int *value, char *next);
 /// @return 0 if the integer was written successfully, 1 otherwise.
 int print_uint(int fd, unsigned int value);
 
+/// Formats an unsigned integer in decimal, two digits at a time and without sprintf.
+/// @param buf Buffer with room for UINT_TEXT_MAX characters, no terminator is added.
+/// @param value The value to format.
+/// @return The number of characters written.
+size_t format_uint(char *buf, unsigned int value);
+
+/// Prints seats as text, a line per row with the seats separated by spaces.
+/// @note The rows are formatted into a buffer that is written with a single write each time it fills up,
+/// instead of a write per seat.
+/// @param fd The file descriptor to write to.
+/// @param seats Array of size rows * cols with the seats, row by row.
+/// @param rows The number of rows.
+/// @param cols The number of columns.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+int print_seats(int fd, const unsigned int *seats, size_t rows, size_t cols);
+
 /// Writes a string to the given file descriptor.
 /// @param fd The file descriptor to write to.
 /// @param str The string to write.
@@ -0,0 +1,87 @@
+#include "protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+void frame_buffer_init(struct FrameBuffer *frames) {
+  frames->start = 0;
+  frames->end = 0;
+}
+
+int frame_buffer_fill(struct FrameBuffer *frames, int fd) {
+  // What is left of a partial frame moves to the front, so the rest of it has room behind it
+  if (frames->start > 0) {
+    memmove(frames->data, frames->data + frames->start, frames->end - frames->start);
+    frames->end -= frames->start;
+    frames->start = 0;
+  }
+
+  ssize_t read_bytes;
+  do {
+    read_bytes = read(fd, frames->data + frames->end, sizeof(frames->data) - frames->end);
+  } while (read_bytes == -1 && errno == EINTR);
+
+  if (read_bytes <= 0) {
+    return read_bytes == 0 ? 0 : -1;
+  }
+
+  frames->end += (size_t)read_bytes;
+  return 1;
+}
+
+int frame_next(struct FrameBuffer *frames, struct FrameHeader *header, const char **payload) {
+  size_t available = frames->end - frames->start;
+  if (available < sizeof(struct FrameHeader)) {
+    return 0;
+  }
+
+  memcpy(header, frames->data + frames->start, sizeof(struct FrameHeader));
+  if (header->length > sizeof(frames->data) - sizeof(struct FrameHeader)) {
+    return -1;
+  }
+  if (available - sizeof(struct FrameHeader) < header->length) {
+    return 0;
+  }
+
+  *payload = frames->data + frames->start + sizeof(struct FrameHeader);
+  frames->start += sizeof(struct FrameHeader) + header->length;
+  return 1;
+}
+
+int frame_write(int fd, uint32_t opcode, uint32_t request_id, const void *payload, size_t length) {
+  struct FrameHeader header = {(uint32_t)length, opcode, request_id};
+  struct iovec iov[2] = {{&header, sizeof(header)}, {(void *)payload, length}};
+  size_t left = sizeof(header) + length;
+  int count = length > 0 ? 2 : 1;
+  struct iovec *next = iov;
+
+  while (left > 0) {
+    ssize_t written = writev(fd, next, count);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+
+    left -= (size_t)written;
+    for (size_t done = (size_t)written; count > 0 && done > 0;) {
+      size_t step = done < next->iov_len ? done : next->iov_len;
+      next->iov_base = (char *)next->iov_base + step;
+      next->iov_len -= step;
+      done -= step;
+      if (next->iov_len == 0) {
+        next++;
+        count--;
+      }
+    }
+  }
+
+  return 0;
+}
+
+uint32_t frame_field(const char *payload, size_t index) {
+  uint32_t value;
+  memcpy(&value, payload + index * sizeof(uint32_t), sizeof(uint32_t));
+  return value;
+}
@@ -0,0 +1,88 @@
+#ifndef COMMON_PROTOCOL_H
+#define COMMON_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/constants.h"
+
+/// Protocol v1 sends an op code and then each field of a request in its native size, with a read per field.
+/// Protocol v2 frames every request and response with a fixed header and sends every field as a uint32_t in the
+/// byte order of the host, which is the same on both ends of a FIFO. A session starts in v1, the client asks for
+/// v2 with OP_VERSION right after the server sends its session id.
+
+#define PROTOCOL_VERSION 2  // Newest version of the protocol spoken by this build
+
+enum Opcode {
+  OP_SETUP = '1',         // Sent to the server pipe to open a session
+  OP_QUIT = '2',          // Ends the session
+  OP_CREATE = '3',        // event_id, num_rows, num_cols -> result
+  OP_RESERVE = '4',       // event_id, num_seats, xs, ys -> result
+  OP_SHOW = '5',          // event_id -> result, num_rows, num_cols, seats
+  OP_LIST = '6',          // -> result, num_events, ids
+  OP_RESERVE_BEST = '7',  // event_id, num_seats, contiguous -> result, reservation_id, num_seats, xs, ys
+  OP_VERSION = '8',       // v1 only, version asked for -> version agreed on
+  OP_BATCH = '9'          // num_ops, then each op code and its fields -> result, then a result per op, then the
+                          // response to each SHOW, in order
+};
+
+/// CREATE, RESERVE or SHOW carried in a batch, with the fields of the request of the same op code.
+struct BatchOp {
+  uint32_t opcode;        // OP_CREATE, OP_RESERVE or OP_SHOW
+  unsigned int event_id;  // Id of the event
+  size_t num_rows;        // Rows of the event to create, CREATE only
+  size_t num_cols;        // Columns of the event to create, CREATE only
+  size_t num_seats;       // Number of seats to reserve, RESERVE only
+  size_t *xs;             // Rows of the seats to reserve, RESERVE only
+  size_t *ys;             // Columns of the seats to reserve, RESERVE only
+};
+
+/// Header in front of every v2 message.
+struct FrameHeader {
+  uint32_t length;      // Bytes of payload after the header
+  uint32_t opcode;      // Op code of the request, echoed in its response
+  uint32_t request_id;  // Chosen by the client, echoed in the response
+};
+
+/// Requests read ahead from a pipe. Whole frames are handed out straight from the buffer, so a request
+/// costs no read of its own once a large read has brought it in.
+struct FrameBuffer {
+  size_t start;                  // Index of the first byte not handed out
+  size_t end;                    // Number of bytes in the buffer
+  char data[FRAME_BUFFER_SIZE];  // Bytes read from the pipe
+};
+
+/// Initializes an empty frame buffer.
+/// @param frames The buffer to initialize.
+void frame_buffer_init(struct FrameBuffer *frames);
+
+/// Reads as many bytes as fit in the buffer with a single read.
+/// @param frames The buffer to fill.
+/// @param fd The file descriptor to read from.
+/// @return 1 if bytes were read, 0 at the end of the file, -1 on error, with errno set.
+int frame_buffer_fill(struct FrameBuffer *frames, int fd);
+
+/// Takes the next whole frame out of the buffer.
+/// @note The payload points into the buffer and is only valid until the buffer is filled again.
+/// @param frames The buffer to take the frame from.
+/// @param header Pointer to the variable to store the header in.
+/// @param payload Pointer to the variable to store the address of the payload in.
+/// @return 1 if a frame was taken, 0 if the buffer does not hold a whole frame yet, -1 if the frame can never fit.
+int frame_next(struct FrameBuffer *frames, struct FrameHeader *header, const char **payload);
+
+/// Writes a frame with a single writev.
+/// @param fd The file descriptor to write to.
+/// @param opcode The op code of the frame.
+/// @param request_id The request id of the frame.
+/// @param payload The payload.
+/// @param length The number of bytes of payload.
+/// @return 0 if the frame was written successfully, 1 otherwise.
+int frame_write(int fd, uint32_t opcode, uint32_t request_id, const void *payload, size_t length);
+
+/// Gets a field of a payload.
+/// @param payload The payload.
+/// @param index Index of the field.
+/// @return The value of the field.
+uint32_t frame_field(const char *payload, size_t index);
+
+#endif  // COMMON_PROTOCOL_H
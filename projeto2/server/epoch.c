@@ -0,0 +1,157 @@
+#include "epoch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/constants.h"
+#include "slab.h"
+
+// Memory waiting for every reader of its epoch to leave
+struct Retired {
+  void* ptr;
+  size_t size;
+  struct Retired* next;
+};
+
+// Per-thread record, registered the first time the thread enters an epoch
+struct EpochRecord {
+  atomic_ulong epoch;       // Epoch observed when the thread last entered
+  atomic_int active;        // 1 while the thread is reading
+  int depth;                // Nesting depth of epoch_enter, only touched by the owner thread
+  struct Retired* pending;  // Memory retired by the thread and not yet handed to the limbo
+  size_t num_pending;       // Number of entries in pending
+  struct EpochRecord* next;
+};
+
+static atomic_ulong global_epoch = 1;
+static _Atomic(struct EpochRecord*) records = NULL;
+static _Thread_local struct EpochRecord* local_record = NULL;
+
+// Retired memory by epoch modulo 3, only the current and previous epochs can still be in use
+static struct Retired* limbo[3] = {NULL, NULL, NULL};
+static pthread_mutex_t limbo_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// Gets the record of the calling thread, registering it if needed.
+/// @return Record of the calling thread.
+static struct EpochRecord* get_record() {
+  if (local_record != NULL) return local_record;
+
+  struct EpochRecord* record = malloc(sizeof(struct EpochRecord));
+  if (record == NULL) {
+    perror("Failed to allocate epoch record");
+    exit(EXIT_FAILURE);
+  }
+  atomic_init(&record->epoch, 0);
+  atomic_init(&record->active, 0);
+  record->depth = 0;
+  record->pending = NULL;
+  record->num_pending = 0;
+
+  record->next = atomic_load(&records);
+  while (!atomic_compare_exchange_weak(&records, &record->next, record))
+    ;
+
+  local_record = record;
+  return record;
+}
+
+/// Frees a list of retired memory.
+/// @param retired List to be freed.
+static void free_retired(struct Retired* retired) {
+  while (retired) {
+    struct Retired* next = retired->next;
+    slab_free(retired->ptr, retired->size);
+    slab_free(retired, sizeof(struct Retired));
+    retired = next;
+  }
+}
+
+/// Advances the global epoch if every active reader has observed the current one.
+/// @note Must be called with limbo_mutex held.
+/// @return Memory retired two epochs before the new one, now safe to free, NULL if the epoch did not advance.
+static struct Retired* try_advance() {
+  unsigned long epoch = atomic_load(&global_epoch);
+
+  for (struct EpochRecord* record = atomic_load(&records); record; record = record->next) {
+    if (atomic_load(&record->active) && atomic_load(&record->epoch) != epoch) return NULL;
+  }
+
+  atomic_store(&global_epoch, epoch + 1);
+
+  // Epoch - 1 shares its bucket with epoch + 2, which is about to be reused
+  struct Retired* reclaimable = limbo[(epoch + 2) % 3];
+  limbo[(epoch + 2) % 3] = NULL;
+  return reclaimable;
+}
+
+void epoch_enter() {
+  struct EpochRecord* record = get_record();
+  if (record->depth++ > 0) return;
+
+  atomic_store(&record->active, 1);
+  atomic_store(&record->epoch, atomic_load(&global_epoch));
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+void epoch_exit() {
+  struct EpochRecord* record = get_record();
+  if (--record->depth > 0) return;
+
+  atomic_store_explicit(&record->active, 0, memory_order_release);
+}
+
+void epoch_retire(void* ptr, size_t size) {
+  struct Retired* retired = slab_alloc(sizeof(struct Retired));
+  if (retired == NULL) {
+    perror("Failed to allocate retired node");
+    exit(EXIT_FAILURE);
+  }
+  retired->ptr = ptr;
+  retired->size = size;
+
+  // Retired memory is handed over in batches to keep the limbo mutex off the reservation path
+  struct EpochRecord* record = get_record();
+  retired->next = record->pending;
+  record->pending = retired;
+  if (++record->num_pending < EPOCH_RETIRE_BATCH) return;
+
+  struct Retired* last = retired;
+  while (last->next) {
+    last = last->next;
+  }
+
+  pthread_mutex_lock(&limbo_mutex);
+  // Tagging the whole batch with the current epoch only delays freeing the older entries
+  unsigned long epoch = atomic_load(&global_epoch);
+  last->next = limbo[epoch % 3];
+  limbo[epoch % 3] = record->pending;
+
+  // Two advances are needed before anything retired now can be freed
+  struct Retired* reclaimable[2] = {try_advance(), try_advance()};
+  pthread_mutex_unlock(&limbo_mutex);
+
+  free_retired(reclaimable[0]);
+  free_retired(reclaimable[1]);
+
+  record->pending = NULL;
+  record->num_pending = 0;
+}
+
+void epoch_terminate() {
+  pthread_mutex_lock(&limbo_mutex);
+  for (int i = 0; i < 3; i++) {
+    free_retired(limbo[i]);
+    limbo[i] = NULL;
+  }
+  pthread_mutex_unlock(&limbo_mutex);
+
+  struct EpochRecord* record = atomic_exchange(&records, NULL);
+  while (record) {
+    struct EpochRecord* next = record->next;
+    free_retired(record->pending);
+    free(record);
+    record = next;
+  }
+}
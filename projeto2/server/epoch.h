@@ -0,0 +1,27 @@
+#ifndef SERVER_EPOCH_H
+#define SERVER_EPOCH_H
+
+#include <stddef.h>
+
+/// Epoch-based reclamation for memory read without locks.
+/// Readers wrap their accesses in epoch_enter/epoch_exit; writers that unpublish
+/// memory hand it to epoch_retire, which frees it once no reader can still see it.
+/// Retired memory must come from slab_alloc, it is given back with slab_free.
+
+/// Marks the calling thread as reading shared memory.
+/// @note Calls may be nested, the thread stays protected until the outermost epoch_exit.
+void epoch_enter();
+
+/// Marks the calling thread as no longer reading shared memory.
+void epoch_exit();
+
+/// Retires memory that is no longer reachable by new readers.
+/// @param ptr Memory to be freed once every reader that may hold it has exited.
+/// @param size Size ptr was allocated with.
+void epoch_retire(void* ptr, size_t size);
+
+/// Frees every retired pointer and every thread record.
+/// @note Must only be called when no other thread is reading.
+void epoch_terminate();
+
+#endif  // SERVER_EPOCH_H
@@ -0,0 +1,324 @@
+#include "eventLoop.h"
+
+#if EVENT_LOOP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/protocol.h"
+#include "outbox.h"
+#include "sessionFn.h"
+#include "slab.h"
+
+static int epoll_fd = -1;
+static int sweep_fd = -1;  // Timer that wakes a thread to check the sessions still waiting for their client
+static Session* sessions[EVENT_LOOP_MAX_SESSIONS];  // Open sessions by session id, NULL for free ids
+static pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int event_loop_init() {
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd == -1) {
+    fprintf(stderr, "Failed to create epoll instance\n");
+    return 1;
+  }
+
+  // The timer is the only thing watched without a session, which is how its wakeups are told apart
+  struct itimerspec every = {{EVENT_LOOP_OPEN_TIMEOUT, 0}, {EVENT_LOOP_OPEN_TIMEOUT, 0}};
+  struct epoll_event watched = {EPOLLIN | EPOLLONESHOT, {.ptr = NULL}};
+  sweep_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (sweep_fd == -1 || timerfd_settime(sweep_fd, 0, &every, NULL) != 0 ||
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sweep_fd, &watched) != 0) {
+    fprintf(stderr, "Failed to create session timer\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Takes a free session id for a session.
+/// @param session The session to give the id to.
+/// @return 0 if an id was given, 1 if every id is taken.
+static int claim_session_id(Session* session) {
+  int ret_value = 1;
+  pthread_mutex_lock(&sessions_mutex);
+  for (int i = 0; i < EVENT_LOOP_MAX_SESSIONS; i++) {
+    if (sessions[i] == NULL) {
+      sessions[i] = session;
+      session->session_id = i;
+      ret_value = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sessions_mutex);
+  return ret_value;
+}
+
+/// Gives back the id and the memory of a session that ended.
+/// @param session The session to release.
+static void release_session(Session* session) {
+  pthread_mutex_lock(&sessions_mutex);
+  sessions[session->session_id] = NULL;
+  pthread_mutex_unlock(&sessions_mutex);
+  outbox_destroy(&session->replies);
+  free(session->frames);
+  free(session);
+}
+
+/// Opens the pipes of a client without waiting for it. The request pipe is opened for reading, which never
+/// blocks when non-blocking. The response pipe is opened for reading and writing, which never blocks either and
+/// lets the client open its end whenever it gets to it.
+/// @param req_pipe_path Path of the request pipe of the client.
+/// @param resp_pipe_path Path of the response pipe of the client.
+/// @param req_pipe Pointer to the variable to store the request pipe in.
+/// @param resp_pipe Pointer to the variable to store the response pipe in.
+/// @return 0 if the pipes were opened successfully, 1 otherwise.
+static int open_pipes(const char* req_pipe_path, const char* resp_pipe_path, int* req_pipe, int* resp_pipe) {
+  *req_pipe = open(req_pipe_path, O_RDONLY | O_NONBLOCK);
+  if (*req_pipe == -1) {
+    fprintf(stderr, "Failed to open request pipe\n");
+    return 1;
+  }
+  *resp_pipe = open(resp_pipe_path, O_RDWR | O_NONBLOCK);
+  if (*resp_pipe == -1) {
+    fprintf(stderr, "Failed to open response pipe\n");
+    close(*req_pipe);
+    return 1;
+  }
+  return 0;
+}
+
+/// Turns away a client when every session id is taken. Its pipes are opened and closed without a session id
+/// being sent, so a client already waiting on them fails its setup.
+/// @param req_pipe_path Path of the request pipe of the client.
+/// @param resp_pipe_path Path of the response pipe of the client.
+static void reject_client(const char* req_pipe_path, const char* resp_pipe_path) {
+  int req_pipe, resp_pipe;
+  if (open_pipes(req_pipe_path, resp_pipe_path, &req_pipe, &resp_pipe) == 0) {
+    close(resp_pipe);
+    close(req_pipe);
+  }
+}
+
+/// Watches one of the pipes of a session for a single wakeup. Only one pipe of a session is watched at a time,
+/// so no two threads ever serve the same session.
+/// @param fd The pipe to watch.
+/// @param events EPOLLIN to wait for requests, EPOLLOUT to wait for room for the answers.
+/// @param session The session the pipe belongs to.
+/// @return 0 if the pipe is watched, 1 otherwise.
+static int watch_pipe(int fd, uint32_t events, Session* session) {
+  struct epoll_event watched = {events | EPOLLONESHOT, {.ptr = session}};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &watched) == 0) {
+    return 0;
+  }
+  return errno == ENOENT && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &watched) == 0 ? 0 : 1;
+}
+
+int event_loop_accept(const char* req_pipe_path, const char* resp_pipe_path) {
+  // Sessions are only allocated while they are open, and their request buffer only once they are read from
+  Session* session = calloc(1, sizeof(Session));
+  if (session == NULL) {
+    fprintf(stderr, "Error allocating memory for session\n");
+    reject_client(req_pipe_path, resp_pipe_path);
+    return 1;
+  }
+
+  // Everything the timer checks is set before the session can be seen by it
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  session->open_deadline = now.tv_sec + EVENT_LOOP_OPEN_TIMEOUT;
+  strncpy(session->req_pipe_path, req_pipe_path, sizeof(session->req_pipe_path) - 1);
+  session->req_pipe_path[sizeof(session->req_pipe_path) - 1] = '\0';
+  strncpy(session->resp_pipe_path, resp_pipe_path, sizeof(session->resp_pipe_path) - 1);
+  session->resp_pipe_path[sizeof(session->resp_pipe_path) - 1] = '\0';
+  outbox_init(&session->replies, -1);
+
+  if (claim_session_id(session) != 0) {
+    fprintf(stderr, "Too many sessions, client turned away\n");
+    free(session);
+    reject_client(req_pipe_path, resp_pipe_path);
+    return 1;
+  }
+
+  // The host thread never waits for a client, one that never opens its pipes keeps its session id until the timer
+  // finds it
+  if (open_pipes(session->req_pipe_path, session->resp_pipe_path, &session->req_pipe, &session->resp_pipe) != 0) {
+    release_session(session);
+    return 1;
+  }
+  if (session_start(session) != 0) {
+    close(session->req_pipe);
+    close(session->resp_pipe);
+    release_session(session);
+    return 1;
+  }
+  if (watch_pipe(session->req_pipe, EPOLLIN, session) != 0) {
+    fprintf(stderr, "Failed to watch request pipe\n");
+    session_end(session);
+    release_session(session);
+    return 1;
+  }
+  return 0;
+}
+
+/// Answers the OP_VERSION a session starts with. The client opened its response pipe before it could read its
+/// session id and ask for a version, so the pipe is reopened write-only: from then on a client that goes away
+/// makes the writes fail instead of filling a pipe the server itself holds open for reading.
+/// @param session The session in protocol v1.
+/// @return 0 if the session is in protocol v2 or waits for the rest of the handshake, 1 if it ended.
+static int serve_handshake(Session* session) {
+  struct FrameBuffer* frames = session->frames;
+  uint32_t version;
+  if (frames->end - frames->start < sizeof(char) + sizeof(uint32_t)) {
+    return 0;
+  }
+  memcpy(&version, frames->data + frames->start + sizeof(char), sizeof(uint32_t));
+  if (frames->data[frames->start] != OP_VERSION || version < 2) {
+    fprintf(stderr, "Session %d: only protocol v2 is served in the event loop\n", session->session_id);
+    session_end(session);
+    return 1;
+  }
+  frames->start += sizeof(char) + sizeof(uint32_t);
+
+  int resp_pipe = open(session->resp_pipe_path, O_WRONLY | O_NONBLOCK);
+  if (resp_pipe == -1) {
+    fprintf(stderr, "Session %d: failed to reopen response pipe\n", session->session_id);
+    session_end(session);
+    return 1;
+  }
+  close(session->resp_pipe);
+  session->resp_pipe = resp_pipe;
+  session->replies.fd = resp_pipe;
+
+  if (session_negotiate(session, version) != 0) {
+    session_end(session);
+    return 1;
+  }
+  return 0;
+}
+
+/// Serves a session that woke up. Answers left from an earlier wakeup are written first, and no request is read
+/// until the client took them all. Otherwise a single read is made, so a client that keeps sending does not hold
+/// the thread while other sessions wait.
+/// @param session The session to serve.
+/// @return 0 if the session waits for more requests or for room for its answers, 1 if it ended.
+static int serve_session(Session* session) {
+  if (outbox_pending(&session->replies) > 0) {
+    return session_serve_frames(session);
+  }
+
+  if (session->frames == NULL) {
+    session->frames = malloc(sizeof(struct FrameBuffer));
+    if (session->frames == NULL) {
+      fprintf(stderr, "Session %d: failed to allocate request buffer\n", session->session_id);
+      session_end(session);
+      return 1;
+    }
+    frame_buffer_init(session->frames);
+  }
+
+  int ret_fill = frame_buffer_fill(session->frames, session->req_pipe);
+  if (ret_fill == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  if (ret_fill != 1) {
+    fprintf(stderr, "Session %d: request pipe closed\n", session->session_id);
+    session_end(session);
+    return 1;
+  }
+
+  // The client sends nothing else until its OP_VERSION is answered, so it is alone in the buffer
+  if (session->version == 1) {
+    if (serve_handshake(session) != 0) return 1;
+    if (session->version == 1) return 0;
+  }
+  return session_serve_frames(session);
+}
+
+/// Ends the sessions whose clients did not open their request pipe in time. The request pipe of each session past
+/// its deadline is opened for writing and closed again, which leaves a client that opened it untouched. Otherwise
+/// the session wakes up to the end of the file, and ends like one whose client went away.
+static void sweep_sessions() {
+  uint64_t expirations;
+  struct timespec now;
+  if (read(sweep_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+    fprintf(stderr, "Failed to read session timer\n");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&sessions_mutex);
+  for (int i = 0; i < EVENT_LOOP_MAX_SESSIONS; i++) {
+    Session* session = sessions[i];
+    if (session == NULL || session->open_deadline == 0 || session->open_deadline > now.tv_sec) continue;
+
+    session->open_deadline = 0;
+    int req_pipe = open(session->req_pipe_path, O_WRONLY | O_NONBLOCK);
+    if (req_pipe != -1) close(req_pipe);
+  }
+  pthread_mutex_unlock(&sessions_mutex);
+
+  struct epoll_event watched = {EPOLLIN | EPOLLONESHOT, {.ptr = NULL}};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sweep_fd, &watched) != 0) {
+    fprintf(stderr, "Failed to watch session timer\n");
+  }
+}
+
+void* event_loop_fn(void* arg) {
+  (void)arg;
+  sigset_t blocked;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGUSR1);
+  if (pthread_sigmask(SIG_BLOCK, &blocked, NULL) != 0) {
+    fprintf(stderr, "Failed to block SIGUSR1\n");
+    exit(EXIT_FAILURE);
+  }
+
+  struct epoll_event ready[EVENT_LOOP_BATCH];
+  while (1) {
+    int count = epoll_wait(epoll_fd, ready, EVENT_LOOP_BATCH, -1);
+    if (count == -1) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Failed to wait for sessions\n");
+      exit(EXIT_FAILURE);
+    }
+
+    // A session reported ready is disarmed until one of its pipes is watched again here
+    for (int i = 0; i < count; i++) {
+      Session* session = ready[i].data.ptr;
+      if (session == NULL) {
+        sweep_sessions();
+        continue;
+      }
+#ifdef ALLOC_COUNT
+      // The session may be served by another thread on its next wakeup, so its count only follows it while served
+      slab_count_mallocs(&session->mallocs);
+#endif
+      int ended = serve_session(session);
+#ifdef ALLOC_COUNT
+      slab_count_mallocs(NULL);
+#endif
+      if (ended != 0) {
+        release_session(session);
+        continue;
+      }
+
+      int pending = outbox_pending(&session->replies) > 0;
+      if (watch_pipe(pending ? session->resp_pipe : session->req_pipe, pending ? EPOLLOUT : EPOLLIN, session) != 0) {
+        fprintf(stderr, "Failed to watch session pipes\n");
+        session_end(session);
+        release_session(session);
+      }
+    }
+  }
+  return NULL;
+}
+
+#endif  // EVENT_LOOP
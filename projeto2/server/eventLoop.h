@@ -0,0 +1,31 @@
+#ifndef SERVER_EVENT_LOOP_H
+#define SERVER_EVENT_LOOP_H
+
+#include <stddef.h>
+
+#include "common/constants.h"
+
+/// In the event loop, built with EVENT_LOOP=1, sessions are not tied to threads. Their pipes are non-blocking
+/// and watched by a single epoll instance, and EVENT_LOOP_THREADS threads serve whichever sessions have
+/// requests, or room for the answers they could not write yet. Each session keeps its partial requests and
+/// its unsent answers in its own buffers between wakeups, so neither an idle client nor one that stops
+/// reading costs a thread. A client that never opens its request pipe has its session ended after
+/// EVENT_LOOP_OPEN_TIMEOUT to EVENT_LOOP_OPEN_TIMEOUT * 2 seconds.
+/// @note Only protocol v2 sessions are served, the v1 handshake is the only v1 request accepted.
+
+/// Creates the epoll instance the sessions are registered with.
+/// @return 0 if the event loop was initialized successfully, 1 otherwise.
+int event_loop_init();
+
+/// Opens the session of a client and starts watching its request pipe.
+/// @note Called by the host thread, which does not wait for the client to open its end of the pipes.
+/// @param req_pipe_path Path of the request pipe of the client.
+/// @param resp_pipe_path Path of the response pipe of the client.
+/// @return 0 if the session was opened successfully, 1 otherwise.
+int event_loop_accept(const char *req_pipe_path, const char *resp_pipe_path);
+
+/// The thread function that serves the sessions with requests ready.
+/// @param arg Unused.
+void *event_loop_fn(void *arg);
+
+#endif  // SERVER_EVENT_LOOP_H
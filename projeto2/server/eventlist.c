@@ -1,74 +1,180 @@
 #include "eventlist.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 
+#include "epoch.h"
+#include "seatmap.h"
+#include "slab.h"
+
+#define INITIAL_CAPACITY 128
+
+/// Hashes an event id into a slot index.
+/// @param event_id Event id.
+/// @param capacity Number of slots, must be a power of two.
+/// @return Index of the first slot to probe.
+static size_t slot_index(unsigned int event_id, size_t capacity) {
+  return (size_t)(event_id * 2654435761u) & (capacity - 1);
+}
+
+/// Gets the size of a table.
+/// @param capacity Number of slots.
+/// @return Bytes taken by the table.
+static size_t table_size(size_t capacity) {
+  return sizeof(struct EventTable) + capacity * sizeof(_Atomic(struct ListNode*));
+}
+
+/// Allocates an empty table.
+/// @param capacity Number of slots, must be a power of two.
+/// @return Newly created table, NULL on failure.
+static struct EventTable* create_table(size_t capacity) {
+  struct EventTable* table = slab_alloc(table_size(capacity));
+  if (!table) return NULL;
+
+  table->capacity = capacity;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&table->slots[i], NULL);
+  }
+  return table;
+}
+
+/// Inserts a node in the first free slot of its probe sequence.
+/// @param table Table to be modified.
+/// @param node Node to be inserted.
+static void insert_in_table(struct EventTable* table, struct ListNode* node) {
+  size_t mask = table->capacity - 1;
+  size_t index = slot_index(node->event->id, table->capacity);
+
+  while (atomic_load_explicit(&table->slots[index], memory_order_relaxed) != NULL) {
+    index = (index + 1) & mask;
+  }
+  atomic_store_explicit(&table->slots[index], node, memory_order_release);
+}
+
+/// Replaces the table with one twice as large, retiring the old one.
+/// @param list Event list to be resized.
+/// @return 0 if the table was replaced successfully, 1 otherwise.
+static int grow_table(struct EventList* list) {
+  struct EventTable* old_table = atomic_load_explicit(&list->table, memory_order_relaxed);
+  struct EventTable* new_table = create_table(old_table->capacity * 2);
+  if (!new_table) return 1;
+
+  struct ListNode* current = atomic_load_explicit(&list->head, memory_order_relaxed);
+  for (; current; current = atomic_load_explicit(&current->next, memory_order_relaxed)) {
+    insert_in_table(new_table, current);
+  }
+
+  // Readers may still be probing the old table, so it is only freed once they leave
+  atomic_store_explicit(&list->table, new_table, memory_order_release);
+  epoch_retire(old_table, table_size(old_table->capacity));
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
-  if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
+  if (pthread_mutex_init(&list->mutex, NULL) != 0) {
     free(list);
     return NULL;
   }
-  list->head = NULL;
-  list->tail = NULL;
+  struct EventTable* table = create_table(INITIAL_CAPACITY);
+  if (!table) {
+    pthread_mutex_destroy(&list->mutex);
+    free(list);
+    return NULL;
+  }
+  atomic_init(&list->table, table);
+  atomic_init(&list->head, NULL);
+  atomic_init(&list->tail, NULL);
+  list->size = 0;
   return list;
 }
 
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  // Keep the load factor at or below 1/2 so probe sequences stay short
+  struct EventTable* table = atomic_load_explicit(&list->table, memory_order_relaxed);
+  if (2 * (list->size + 1) > table->capacity) {
+    if (grow_table(list) != 0) return 1;
+    table = atomic_load_explicit(&list->table, memory_order_relaxed);
+  }
+
+  struct ListNode* new_node = slab_alloc(sizeof(struct ListNode));
   if (!new_node) return 1;
 
   new_node->event = event;
-  new_node->next = NULL;
+  new_node->position = list->size;
+  atomic_init(&new_node->next, NULL);
 
-  if (list->head == NULL) {
-    list->head = new_node;
-    list->tail = new_node;
+  // The node is fully built before it becomes reachable from the list or the table
+  struct ListNode* tail = atomic_load_explicit(&list->tail, memory_order_relaxed);
+  if (tail == NULL) {
+    atomic_store_explicit(&list->head, new_node, memory_order_release);
   } else {
-    list->tail->next = new_node;
-    list->tail = new_node;
+    atomic_store_explicit(&tail->next, new_node, memory_order_release);
   }
+  insert_in_table(table, new_node);
+  atomic_store_explicit(&list->tail, new_node, memory_order_release);
+  list->size++;
 
   return 0;
 }
 
 static void free_event(struct Event* event) {
   if (!event) return;
-  free(event->data);
-  free(event);
+  seatmap_free(event);
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    pthread_mutex_destroy(&event->stripes[i]);
+  }
+  slab_free(event->stripes, event->num_stripes * sizeof(pthread_mutex_t));
+  pthread_mutex_destroy(&event->mutex);
+  slab_free(event, event->size);
 }
 
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
+  struct ListNode* current = atomic_load(&list->head);
   while (current) {
     struct ListNode* temp = current;
-    current = current->next;
+    current = atomic_load(&current->next);
 
     free_event(temp->event);
-    free(temp);
+    slab_free(temp, sizeof(struct ListNode));
   }
 
+  struct EventTable* table = atomic_load(&list->table);
+  slab_free(table, table_size(table->capacity));
+  pthread_mutex_destroy(&list->mutex);
   free(list);
 }
 
 struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
   if (!list || !from || !to) return NULL;
-  struct ListNode* current = from;
+  struct Event* found = NULL;
+
+  epoch_enter();
+  struct EventTable* table = atomic_load_explicit(&list->table, memory_order_acquire);
+  size_t mask = table->capacity - 1;
+  size_t index = slot_index(event_id, table->capacity);
 
   while (1) {
-    if (current->event->id == event_id) {
-      return current->event;
+    struct ListNode* current = atomic_load_explicit(&table->slots[index], memory_order_acquire);
+    if (current == NULL) {
+      break;
     }
 
-    if (current == to) {
-      return NULL;
+    // Only nodes between from and to (in insertion order) are visible to the caller
+    if (current->event->id == event_id && current->position >= from->position && current->position <= to->position) {
+      found = current->event;
+      break;
     }
 
-    current = current->next;
+    index = (index + 1) & mask;
   }
+  epoch_exit();
+
+  return found;
 }
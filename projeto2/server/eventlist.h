@@ -2,29 +2,66 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// Immutable version of a seat map, bands and tiles are shared between versions until a reservation copies them.
+// A band holds SEAT_TILE_ROWS rows as an array of num_tiles pointers to tiles of SEAT_TILE_COLS columns,
+// followed by one byte per tile with the width its seats are stored at.
+// Bands and tiles are NULL while all their seats are free.
+struct SeatMap {
+  size_t num_bands;  // Number of bands
+  size_t num_tiles;  // Number of tiles in each band
+  void** bands[];    // Bands of the seat map
+};
 
 struct Event {
-  unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  unsigned int id;           /// Event id
+  size_t size;               /// Bytes of the allocation holding the event and its occupancy arrays.
+  atomic_uint reservations;  /// Number of reservations for the event.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
-  pthread_mutex_t mutex;  // Mutex to protect the event
+  size_t order;  /// Creation order of the event across all shards.
+
+  _Atomic(struct SeatMap*) seats;  /// Current version of the reservations for each seat.
+  atomic_uint readers;             /// Number of pins on a version of the seat map.
+  atomic_uint writers;             /// Number of reservations writing the current version in place.
+  uint64_t* occupied;              /// Bitmap of the reserved seats, rows padded to row_words words.
+  size_t row_words;                /// Number of bitmap words per row.
+  size_t* row_free;                /// Number of free seats in each row.
+  size_t* row_run;                 /// Length of the longest run of free seats in each row.
+  pthread_mutex_t mutex;           // Mutex to protect the event
+
+  atomic_int striped;        /// Whether reservations lock row stripes instead of the whole event.
+  atomic_uint contention;    /// Number of times the event lock was found taken.
+  pthread_mutex_t* stripes;  /// One mutex per STRIPE_ROWS rows, NULL until striped.
+  size_t num_stripes;        /// Number of stripes.
 };
 
 struct ListNode {
   struct Event* event;
-  struct ListNode* next;
+  _Atomic(struct ListNode*) next;
+  size_t position;  // Insertion order of the node in the list
+};
+
+// Open addressing hash table on the event id, replaced as a whole when it grows
+struct EventTable {
+  size_t capacity;                    // Number of slots, always a power of two
+  _Atomic(struct ListNode*) slots[];  // Nodes, NULL for empty slots
 };
 
-// Linked list structure
+// Linked list structure, indexed by a hash table on the event id.
+// Nodes are published with release stores, so readers traverse the list and the
+// table without locking; only writers take the mutex.
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+  _Atomic(struct ListNode*) head;     // Head of the list
+  _Atomic(struct ListNode*) tail;     // Tail of the list
+  _Atomic(struct EventTable*) table;  // Current hash table, reclaimed through epochs
+  size_t size;                        // Number of events in the list
+  pthread_mutex_t mutex;              // Mutex to serialize writers
 };
 
 /// Creates a new event list.
@@ -32,6 +69,7 @@ struct EventList {
 struct EventList* create_list();
 
 /// Appends a new node to the list.
+/// @note The caller must hold the list mutex.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
@@ -43,6 +81,7 @@ int append_to_list(struct EventList* list, struct Event* data);
 void free_list(struct EventList* list);
 
 /// Retrieves an event in the list.
+/// @note Takes no lock, may run concurrently with append_to_list.
 /// @param list Event list to be searched
 /// @param event_id Event id.
 /// @param from First node to be searched.
@@ -12,6 +12,7 @@
 #include "common/io.h"
 #include "eventlist.h"
 #include "common/constants.h"
+#include "eventLoop.h"
 #include "hostFn.h"
 #include "sessionFn.h"
 #include "operations.h"
@@ -43,7 +44,9 @@ void* host_fn(void* arg) {
           fprintf(stderr, "Failed to read for req_pipe\n");
           exit(EXIT_FAILURE);
         }
+#if !EVENT_LOOP
         enqueue_path(req_pipe_path);
+#endif
         
         char resp_pipe_path[MAX_PIPE_NAME_SIZE];
         ret = read(server_pipe, resp_pipe_path, MAX_PIPE_NAME_SIZE);
@@ -51,9 +54,14 @@ void* host_fn(void* arg) {
           fprintf(stderr, "Failed to read for resp_pipe\n");
           exit(EXIT_FAILURE);
         }
+#if EVENT_LOOP
+        // The session is opened right away, there is no session thread to wait for
+        event_loop_accept(req_pipe_path, resp_pipe_path);
+#else
         enqueue_path(resp_pipe_path);
         
         pthread_cond_signal(&pathQueue.not_empty);
+#endif
         break;
       }
       default:
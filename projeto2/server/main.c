@@ -9,11 +9,13 @@
 #include <errno.h>
 
 #include "pathQueue.h"
+#include "eventLoop.h"
 #include "sessionFn.h"
 #include "hostFn.h"
 #include "common/constants.h"
 #include "common/io.h"
 #include "operations.h"
+#include "slab.h"
 
 volatile sig_atomic_t sigusr1_received = 0;
 
@@ -22,8 +24,8 @@ void sigusr1_handler(int signo, siginfo_t* a, void* b) {
 }
 
 int main(int argc, char* argv[]) {
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "Usage: %s\n <pipe_path> [delay] [shards]\n", argv[0]);
     return 1;
   }
 
@@ -40,7 +42,7 @@ int main(int argc, char* argv[]) {
   
   char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
+  if (argc >= 3) {
     unsigned long int delay = strtoul(argv[2], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
@@ -51,11 +53,48 @@ int main(int argc, char* argv[]) {
     state_access_delay_us = (unsigned int)delay;
   }
 
-  if (ems_init(state_access_delay_us)) {
+  size_t shard_count = EVENT_SHARD_COUNT;
+  if (argc == 4) {
+    unsigned long int shards = strtoul(argv[3], &endptr, 10);
+
+    if (*endptr != '\0' || shards == 0 || shards > UINT_MAX) {
+      fprintf(stderr, "Invalid shard count\n");
+      return 1;
+    }
+
+    shard_count = (size_t)shards;
+  }
+
+  if (ems_init(state_access_delay_us, shard_count)) {
     fprintf(stderr, "Failed to initialize EMS\n");
     return 1;
   }
 
+#if EVENT_LOOP
+  // A client that goes away makes writes to its response pipe fail, which ends its session, instead of the server
+  struct sigaction ignore_pipe;
+  ignore_pipe.sa_handler = SIG_IGN;
+  ignore_pipe.sa_flags = 0;
+  sigemptyset(&ignore_pipe.sa_mask);
+  if (sigaction(SIGPIPE, &ignore_pipe, NULL) == -1) {
+    perror("sigaction\n");
+    return 1;
+  }
+
+  // A few threads serve every session, each session is opened by the host thread when its client connects
+  if (event_loop_init()) {
+    fprintf(stderr, "Failed to initialize event loop\n");
+    return 1;
+  }
+
+  pthread_t tid[EVENT_LOOP_THREADS];
+  for (int i = 0; i < EVENT_LOOP_THREADS; i++) {
+    if (pthread_create(&tid[i], NULL, event_loop_fn, NULL) != 0) {
+      fprintf(stderr, "Failed to initialize thread\n");
+      return 1;
+    }
+  }
+#else
   Session sessions[MAX_SESSION_COUNT];
   pthread_t tid[MAX_SESSION_COUNT];
 
@@ -67,6 +106,7 @@ int main(int argc, char* argv[]) {
           return 1;
       }
   }
+#endif
   
   if (mkfifo(argv[1], 0777) == -1) {
     fprintf(stderr, "Failed to create named pipe\n");
@@ -90,9 +130,9 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
   
-  for (int i = 0; i < MAX_SESSION_COUNT; i++) {
+  for (size_t i = 0; i < sizeof(tid) / sizeof(tid[0]); i++) {
       if (pthread_join(tid[i], NULL) != 0) {
-          fprintf(stderr, "Error joining thread %d\n", i);
+          fprintf(stderr, "Error joining thread %zu\n", i);
           exit(EXIT_FAILURE);
       }
   }
@@ -101,4 +141,5 @@ int main(int argc, char* argv[]) {
   close(server_pipe);
   unlink(argv[1]);
   ems_terminate();
+  slab_terminate();
 }
\ No newline at end of file
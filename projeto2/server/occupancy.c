@@ -0,0 +1,158 @@
+#include "occupancy.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/// Gets the word and bit of a seat in the bitmap.
+/// @param event Event the seat belongs to.
+/// @param row Row of the seat (1-based).
+/// @param col Column of the seat (1-based).
+/// @param bit Pointer to the variable to store the bit mask in.
+/// @return Index of the word holding the seat.
+static size_t seat_word(const struct Event* event, size_t row, size_t col, uint64_t* bit) {
+  *bit = (uint64_t)1 << ((col - 1) % 64);
+  return (row - 1) * event->row_words + (col - 1) / 64;
+}
+
+/// Counts the bits set in an array of words.
+/// @param words Words to count.
+/// @param num_words Number of words.
+/// @return Number of bits set.
+static size_t popcount_words(const uint64_t* words, size_t num_words) {
+  size_t total = 0;
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  // Nibble lookup popcount, 256 bits per iteration
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,  //
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 4 <= num_words; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(words + i));
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+    __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)(void*)lanes, acc);
+  total += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+  // Bit-sliced popcount, 128 bits per iteration
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0f);
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 2 <= num_words; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(words + i));
+    v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+    v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+    v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)(void*)lanes, acc);
+  total += (size_t)(lanes[0] + lanes[1]);
+#endif
+
+  for (; i < num_words; i++) {
+    total += (size_t)__builtin_popcountll(words[i]);
+  }
+  return total;
+}
+
+size_t occupancy_size(size_t rows, size_t cols) {
+  size_t row_words = (cols + 63) / 64;
+  return (rows * row_words + 1) * sizeof(uint64_t) + 2 * (rows + 1) * sizeof(size_t);
+}
+
+void occupancy_init(struct Event* event, void* storage) {
+  event->row_words = (event->cols + 63) / 64;
+  size_t num_words = event->rows * event->row_words + 1;
+  event->occupied = storage;
+  event->row_free = (size_t*)(void*)(event->occupied + num_words);
+  event->row_run = event->row_free + event->rows + 1;
+
+  for (size_t i = 0; i < event->rows; i++) {
+    event->row_free[i] = event->cols;
+    event->row_run[i] = event->cols;
+  }
+}
+
+int occupancy_test(const struct Event* event, size_t row, size_t col) {
+  uint64_t bit;
+  size_t word = seat_word(event, row, col, &bit);
+  return (event->occupied[word] & bit) != 0;
+}
+
+void occupancy_set(struct Event* event, size_t row, size_t col) {
+  uint64_t bit;
+  size_t word = seat_word(event, row, col, &bit);
+  event->occupied[word] |= bit;
+}
+
+void occupancy_update_row(struct Event* event, size_t row) {
+  size_t free_seats = 0;
+  size_t run = 0;
+  size_t longest = 0;
+
+  for (size_t col = 1; col <= event->cols; col++) {
+    if (occupancy_test(event, row, col)) {
+      run = 0;
+      continue;
+    }
+    free_seats++;
+    if (++run > longest) longest = run;
+  }
+
+  event->row_free[row - 1] = free_seats;
+  event->row_run[row - 1] = longest;
+}
+
+int occupancy_find_run(const struct Event* event, size_t num_seats, size_t* row, size_t* col) {
+  for (size_t i = 1; i <= event->rows; i++) {
+    // The index rules out rows without a long enough run before touching the bitmap
+    if (event->row_run[i - 1] < num_seats) continue;
+
+    size_t run = 0;
+    for (size_t j = 1; j <= event->cols; j++) {
+      if (occupancy_test(event, i, j)) {
+        run = 0;
+        continue;
+      }
+      if (++run == num_seats) {
+        *row = i;
+        *col = j - num_seats + 1;
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int occupancy_find_free(const struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  size_t found = 0;
+
+  for (size_t i = 1; i <= event->rows && found < num_seats; i++) {
+    if (occupancy_row_full(event, i)) continue;
+
+    for (size_t j = 1; j <= event->cols && found < num_seats; j++) {
+      if (!occupancy_test(event, i, j)) {
+        xs[found] = i;
+        ys[found] = j;
+        found++;
+      }
+    }
+  }
+  return found < num_seats;
+}
+
+size_t occupancy_count_free(const struct Event* event) {
+  return event->rows * event->cols - popcount_words(event->occupied, event->rows * event->row_words);
+}
+
+int occupancy_row_full(const struct Event* event, size_t row) { return event->row_free[row - 1] == 0; }
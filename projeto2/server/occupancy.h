@@ -0,0 +1,70 @@
+#ifndef SERVER_OCCUPANCY_H
+#define SERVER_OCCUPANCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eventlist.h"
+
+/// Gets the bytes taken by the occupancy bitmap and free-run index of an event.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @return Bytes of storage occupancy_init needs.
+size_t occupancy_size(size_t rows, size_t cols);
+
+/// Lays out an empty occupancy bitmap and free-run index for an event and stores them in the event.
+/// @note Each row is padded to a whole number of 64-bit words, padding bits stay 0.
+/// @note The storage belongs to the caller, usually the allocation of the event itself.
+/// @param event Event with rows and cols already set.
+/// @param storage occupancy_size bytes aligned for uint64_t, all set to 0.
+void occupancy_init(struct Event* event, void* storage);
+
+/// Checks whether a seat is reserved.
+/// @note This function assumes that the seat exists.
+/// @param event Event to check.
+/// @param row Row of the seat (1-based).
+/// @param col Column of the seat (1-based).
+/// @return 1 if the seat is reserved, 0 otherwise.
+int occupancy_test(const struct Event* event, size_t row, size_t col);
+
+/// Marks a seat as reserved.
+/// @note This function assumes that the seat exists.
+/// @param event Event to modify.
+/// @param row Row of the seat (1-based).
+/// @param col Column of the seat (1-based).
+void occupancy_set(struct Event* event, size_t row, size_t col);
+
+/// Recomputes the free-run index of a row from the bitmap.
+/// @note Must be called after occupancy_set on every row that was modified.
+/// @param event Event to modify.
+/// @param row Row to recompute (1-based).
+void occupancy_update_row(struct Event* event, size_t row);
+
+/// Finds the first run of free seats of the given length, front rows and left columns first.
+/// @param event Event to search.
+/// @param num_seats Length of the run.
+/// @param row Pointer to the variable to store the row of the run in.
+/// @param col Pointer to the variable to store the first column of the run in.
+/// @return 0 if a run was found, 1 otherwise.
+int occupancy_find_run(const struct Event* event, size_t num_seats, size_t* row, size_t* col);
+
+/// Finds the first free seats, front rows and left columns first.
+/// @param event Event to search.
+/// @param num_seats Number of seats to find.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return 0 if enough seats were found, 1 otherwise.
+int occupancy_find_free(const struct Event* event, size_t num_seats, size_t* xs, size_t* ys);
+
+/// Counts the free seats of an event.
+/// @param event Event to count.
+/// @return Number of seats that are not reserved.
+size_t occupancy_count_free(const struct Event* event);
+
+/// Checks whether every seat of a row is reserved.
+/// @param event Event to check.
+/// @param row Row to check (1-based).
+/// @return 1 if the row is full, 0 otherwise.
+int occupancy_row_full(const struct Event* event, size_t row);
+
+#endif  // SERVER_OCCUPANCY_H
@@ -1,374 +1,866 @@
+#include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "common/constants.h"
 #include "common/io.h"
+#include "common/protocol.h"
+#include "epoch.h"
 #include "eventlist.h"
-
-static struct EventList* event_list = NULL;
+#include "occupancy.h"
+#include "outbox.h"
+#include "operations.h"
+#include "seatmap.h"
+#include "slab.h"
+
+static struct EventList** shards = NULL;
+static size_t num_shards = 0;
+static atomic_size_t creation_counter = 0;
 static unsigned int state_access_delay_us = 0;
 
+/// Gets the shard that holds the event with the given ID.
+/// @param event_id The ID of the event.
+/// @return Event list of the shard.
+static struct EventList* get_shard(unsigned int event_id) {
+  unsigned int hash = (event_id ^ (event_id >> 16)) * 0x45d9f3bu;
+  return shards[(hash ^ (hash >> 16)) % num_shards];
+}
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
+static struct Event* get_event_with_delay(unsigned int event_id) {
   struct timespec delay = {0, state_access_delay_us * 1000};
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id, from, to);
+  struct EventList* shard = get_shard(event_id);
+  struct ListNode* to = atomic_load(&shard->tail);
+  return get_event(shard, event_id, atomic_load(&shard->head), to);
+}
+
+/// Gets the event with the given ID, going to the state only on a cache miss.
+/// @note Events are never removed while the server runs, so a cached handle stays valid for the whole session.
+/// Must be called inside an epoch, which must last while the event is used.
+/// @param cache Event cache of the calling session, may be NULL.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* get_event_cached(struct EventCache* cache, unsigned int event_id) {
+  if (cache == NULL) return get_event_with_delay(event_id);
+
+  for (size_t i = 0; i < EVENT_CACHE_SIZE; i++) {
+    if (cache->events[i] != NULL && cache->ids[i] == event_id) {
+      cache->hits++;
+      return cache->events[i];
+    }
+  }
+
+  cache->misses++;
+  struct Event* event = get_event_with_delay(event_id);
+  if (event != NULL) {
+    cache->ids[cache->next] = event_id;
+    cache->events[cache->next] = event;
+    cache->next = (cache->next + 1) % EVENT_CACHE_SIZE;
+  }
+  return event;
+}
+
+/// Compares two events by creation order.
+static int compare_creation(const void* a, const void* b) {
+  size_t order_a = (*(struct Event* const*)a)->order;
+  size_t order_b = (*(struct Event* const*)b)->order;
+  return (order_a > order_b) - (order_a < order_b);
+}
+
+/// Collects the events of every shard in creation order.
+/// @note Events created while collecting may or may not be included.
+/// @param events Pointer to store the array of events in, to be given back with slab_free, NULL if there are none.
+/// @param num_events Pointer to store the number of events in.
+/// @return 0 if the events were collected successfully, 1 otherwise.
+static int collect_events(struct Event*** events, size_t* num_events) {
+  struct ListNode* bounds[num_shards];
+  size_t count = 0;
+
+  // Snapshot the bounds of every shard, the tail is published after the head
+  for (size_t i = 0; i < num_shards; i++) {
+    bounds[i] = atomic_load(&shards[i]->tail);
+    if (bounds[i] != NULL) count += bounds[i]->position + 1;
+  }
+
+  *events = NULL;
+  *num_events = count;
+  if (count == 0) return 0;
+
+  *events = slab_alloc(count * sizeof(struct Event*));
+  if (*events == NULL) return 1;
+
+  size_t i = 0;
+  for (size_t j = 0; j < num_shards; j++) {
+    struct ListNode* current = bounds[j] != NULL ? atomic_load(&shards[j]->head) : NULL;
+    while (current != NULL) {
+      (*events)[i++] = current->event;
+      if (current == bounds[j]) {
+        break;
+      }
+      current = atomic_load(&current->next);
+    }
+  }
+
+  qsort(*events, count, sizeof(struct Event*), compare_creation);
+  return 0;
+}
+
+/// Checks whether an event has enough rows for striping to pay off.
+/// @param event Event to check.
+/// @return 1 if the event should be striped, 0 otherwise.
+static int stripes_worthwhile(struct Event* event) { return event->rows >= 2 * STRIPE_ROWS; }
+
+/// Splits the rows of an event into lock stripes.
+/// @note The caller must hold the event mutex or be the only one with access to the event.
+/// @param event Event to be striped.
+/// @return 0 if the stripes were created successfully, 1 otherwise.
+static int enable_stripes(struct Event* event) {
+  size_t num_stripes = (event->rows + STRIPE_ROWS - 1) / STRIPE_ROWS;
+  pthread_mutex_t* stripes = slab_alloc(num_stripes * sizeof(pthread_mutex_t));
+  if (stripes == NULL) return 1;
+
+  for (size_t i = 0; i < num_stripes; i++) {
+    if (pthread_mutex_init(&stripes[i], NULL) != 0) {
+      for (size_t j = 0; j < i; j++) {
+        pthread_mutex_destroy(&stripes[j]);
+      }
+      slab_free(stripes, num_stripes * sizeof(pthread_mutex_t));
+      return 1;
+    }
+  }
+
+  event->stripes = stripes;
+  event->num_stripes = num_stripes;
+  atomic_store(&event->striped, 1);
+  return 0;
 }
 
-/// Gets the index of a seat.
-/// @note This function assumes that the seat exists.
-/// @param event Event to get the seat index from.
-/// @param row Row of the seat.
-/// @param col Column of the seat.
-/// @return Index of the seat.
-static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+/// Locks the whole event: its mutex and, if it is striped, every stripe in order.
+/// @param event Event to be locked.
+/// @return 0 if the event was locked successfully, 1 otherwise.
+static int lock_event(struct Event* event) {
+  int ret = pthread_mutex_trylock(&event->mutex);
+  if (ret == EBUSY) {
+    atomic_fetch_add_explicit(&event->contention, 1, memory_order_relaxed);
+    ret = pthread_mutex_lock(&event->mutex);
+  }
+  if (ret != 0) return 1;
 
-int ems_init(unsigned int delay_us) {
-  if (event_list != NULL) {
+  // The striped flag only changes with the mutex held, so it is stable from here
+  if (atomic_load(&event->striped)) {
+    for (size_t i = 0; i < event->num_stripes; i++) {
+      pthread_mutex_lock(&event->stripes[i]);
+    }
+  }
+  return 0;
+}
+
+/// Unlocks an event locked with lock_event.
+/// @param event Event to be unlocked.
+static void unlock_event(struct Event* event) {
+  if (atomic_load(&event->striped)) {
+    for (size_t i = event->num_stripes; i > 0; i--) {
+      pthread_mutex_unlock(&event->stripes[i - 1]);
+    }
+  }
+  pthread_mutex_unlock(&event->mutex);
+}
+
+/// Compares two stripe indices.
+static int compare_stripes(const void* a, const void* b) {
+  size_t stripe_a = *(const size_t*)a;
+  size_t stripe_b = *(const size_t*)b;
+  return (stripe_a > stripe_b) - (stripe_a < stripe_b);
+}
+
+int ems_init(unsigned int delay_us, size_t shard_count) {
+  if (shards != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
     return 1;
   }
 
-  event_list = create_list();
-  state_access_delay_us = delay_us;
+  if (shard_count == 0) {
+    fprintf(stderr, "At least one shard is required\n");
+    return 1;
+  }
 
-  return event_list == NULL;
+  shards = calloc(shard_count, sizeof(struct EventList*));
+  if (shards == NULL) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < shard_count; i++) {
+    shards[i] = create_list();
+    if (shards[i] == NULL) {
+      for (size_t j = 0; j < i; j++) {
+        free_list(shards[j]);
+      }
+      free(shards);
+      shards = NULL;
+      return 1;
+    }
+  }
+
+  num_shards = shard_count;
+  state_access_delay_us = delay_us;
+  return 0;
 }
 
 int ems_terminate() {
-  if (event_list == NULL) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  for (size_t i = 0; i < num_shards; i++) {
+    if (pthread_mutex_lock(&shards[i]->mutex) != 0) {
+      fprintf(stderr, "Error locking shard mutex\n");
+      return 1;
+    }
+    pthread_mutex_unlock(&shards[i]->mutex);
   }
 
-  free_list(event_list);
-  pthread_rwlock_unlock(&event_list->rwl);
+  for (size_t i = 0; i < num_shards; i++) {
+    free_list(shards[i]);
+  }
+  free(shards);
+  shards = NULL;
+  epoch_terminate();
   return 0;
 }
 
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  if (event_list == NULL) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  // Only creates that land on the same shard wait for each other
+  struct EventList* shard = get_shard(event_id);
+  if (pthread_mutex_lock(&shard->mutex) != 0) {
+    fprintf(stderr, "Error locking shard mutex\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
+  if (get_event_with_delay(event_id) != NULL) {
     fprintf(stderr, "Event already exists\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+    pthread_mutex_unlock(&shard->mutex);
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
+  // The occupancy arrays share the allocation of the event, small events fit in a single slab object
+  size_t event_size = sizeof(struct Event) + occupancy_size(num_rows, num_cols);
+  struct Event* event = slab_zalloc(event_size);
 
   if (event == NULL) {
     fprintf(stderr, "Error allocating memory for event\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+    pthread_mutex_unlock(&shard->mutex);
     return 1;
   }
 
   event->id = event_id;
+  event->size = event_size;
   event->rows = num_rows;
   event->cols = num_cols;
-  event->reservations = 0;
+  atomic_init(&event->reservations, 0);
+  atomic_init(&event->striped, 0);
+  atomic_init(&event->contention, 0);
+  atomic_init(&event->readers, 0);
+  atomic_init(&event->writers, 0);
+  event->stripes = NULL;
+  event->num_stripes = 0;
+  event->order = atomic_fetch_add(&creation_counter, 1);
   if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
+    pthread_mutex_unlock(&shard->mutex);
+    slab_free(event, event_size);
     return 1;
   }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
-
-  if (event->data == NULL) {
+  if (seatmap_init(event) != 0) {
     fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
+    pthread_mutex_unlock(&shard->mutex);
+    pthread_mutex_destroy(&event->mutex);
+    slab_free(event, event_size);
     return 1;
   }
+  occupancy_init(event, event + 1);
 
-  if (append_to_list(event_list, event) != 0) {
+  // Large events are striped before anyone can see them, smaller ones once they get contended
+  if (num_rows * num_cols >= STRIPE_MIN_SEATS && stripes_worthwhile(event) && enable_stripes(event) != 0) {
+    fprintf(stderr, "Error allocating memory for event stripes\n");
+  }
+
+  if (append_to_list(shard, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
+    pthread_mutex_unlock(&shard->mutex);
+    seatmap_free(event);
+    for (size_t i = 0; i < event->num_stripes; i++) {
+      pthread_mutex_destroy(&event->stripes[i]);
+    }
+    slab_free(event->stripes, event->num_stripes * sizeof(pthread_mutex_t));
+    pthread_mutex_destroy(&event->mutex);
+    slab_free(event, event_size);
     return 1;
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  pthread_mutex_unlock(&shard->mutex);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
+/// Assigns a new reservation to seats already checked to be free.
+/// @note The caller must be inside an epoch and hold the whole event, or the stripes of every row touched.
+/// @param event Event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param reservation_id Pointer to store the id of the new reservation in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int commit_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, unsigned int* reservation_id) {
+  *reservation_id = ++event->reservations;
+
+  // Readers keep seeing the previous version of the seat map until the new one is published
+  if (seatmap_write(event, num_seats, xs, ys, *reservation_id) != 0) {
+    fprintf(stderr, "Error allocating memory for event data\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  // The bitmap and the free-run index mirror the seat map and are only written here
+  for (size_t i = 0; i < num_seats; i++) {
+    occupancy_set(event, xs[i], ys[i]);
   }
-
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
-
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    return 1;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (i == 0 || xs[i] != xs[i - 1]) occupancy_update_row(event, xs[i]);
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return 1;
-  }
+  return 0;
+}
 
+/// Reserves the given seats in a striped event, locking only the stripes they fall in.
+/// @param event Event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_striped(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
   for (size_t i = 0; i < num_seats; i++) {
     if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
       fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
       return 1;
     }
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
+  // Stripes are always taken in ascending order, so two reservations never deadlock
+  size_t stripes[num_seats];
+  for (size_t i = 0; i < num_seats; i++) {
+    stripes[i] = (xs[i] - 1) / STRIPE_ROWS;
+  }
+  qsort(stripes, num_seats, sizeof(size_t), compare_stripes);
 
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+  size_t num_locked = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (i > 0 && stripes[i] == stripes[i - 1]) continue;
+    pthread_mutex_lock(&event->stripes[stripes[i]]);
+    stripes[num_locked++] = stripes[i];
+  }
 
+  int ret_value = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (occupancy_test(event, xs[i], ys[i])) {
+      fprintf(stderr, "Seat already reserved\n");
+      ret_value = 1;
       break;
     }
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  unsigned int reservation_id;
+  if (ret_value == 0) {
+    ret_value = commit_seats(event, num_seats, xs, ys, &reservation_id);
+  }
+
+  for (size_t i = num_locked; i > 0; i--) {
+    pthread_mutex_unlock(&event->stripes[stripes[i - 1]]);
+  }
+  return ret_value;
+}
+
+/// Reserves the given seats in an event whose whole lock is held.
+/// @note The caller must be inside an epoch and hold the event with lock_event.
+/// @param event Event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_locked(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Seat out of bounds\n");
+      return 1;
+    }
+  }
 
   for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+    if (occupancy_test(event, xs[i], ys[i])) {
+      fprintf(stderr, "Seat already reserved\n");
+      return 1;
+    }
   }
 
-  pthread_mutex_unlock(&event->mutex);
-  return 0;
+  unsigned int reservation_id;
+  return commit_seats(event, num_seats, xs, ys, &reservation_id);
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  ssize_t ret;
-  int ret_value;
+/// Reserves the given seats in an event.
+/// @param event Event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  if (atomic_load(&event->striped)) {
+    return reserve_striped(event, num_seats, xs, ys);
+  }
 
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+  if (lock_event(event) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+  // A hot event switches to striped locking; its new stripes are taken so unlock_event releases them
+  if (!atomic_load(&event->striped) && stripes_worthwhile(event) &&
+      atomic_load(&event->contention) >= STRIPE_CONTENTION_THRESHOLD && enable_stripes(event) == 0) {
+    for (size_t i = 0; i < event->num_stripes; i++) {
+      pthread_mutex_lock(&event->stripes[i]);
+    }
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  int ret_value = reserve_locked(event, num_seats, xs, ys);
+
+  unlock_event(event);
+  return ret_value;
+}
+
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys, struct EventCache* cache) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+  // The seats are staged on the stack all the way down to seatmap_write
+  if (num_seats == 0 || num_seats > MAX_RESERVATION_SIZE) {
+    fprintf(stderr, "Invalid number of seats\n");
+    return 1;
+  }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  epoch_enter();
+  struct Event* event = get_event_cached(cache, event_id);
 
+  int ret_value = 1;
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+  } else {
+    ret_value = reserve_seats(event, num_seats, xs, ys);
   }
+  epoch_exit();
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+  return ret_value;
+}
+
+/// Answers a SHOW or LIST that failed.
+/// @param out Outbox to answer to.
+/// @param request Request being answered in protocol v2, NULL in protocol v1.
+static void write_failure(struct Outbox* out, const struct FrameHeader* request) {
+  int ret_value = 1;
+  struct FrameHeader frame = {sizeof(int), 0, 0};
+  if (request != NULL) {
+    frame.opcode = request->opcode;
+    frame.request_id = request->request_id;
   }
+  if ((request != NULL && outbox_append(out, &frame, sizeof(frame)) != 0) ||
+      outbox_append(out, &ret_value, sizeof(int)) != 0) {
+    fprintf(stderr, "Failed to write\n");
+  }
+}
 
+/// Answers a SHOW with a pinned version of the seat map of an event.
+/// @note The caller must be inside an epoch since before the version was pinned.
+/// @param out Outbox to answer to.
+/// @param event Event to print.
+/// @param map Pinned version of the seat map of the event.
+/// @param request Request being answered in protocol v2, NULL in protocol v1.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int write_seats(struct Outbox* out, struct Event* event, const struct SeatMap* map,
+                       const struct FrameHeader* request) {
   size_t num_rows = event->rows;
   size_t num_cols = event->cols;
-  unsigned int seats[num_rows * num_cols];
-
-  for (size_t i = 1; i <= num_rows; i++) {
-    for (size_t j = 1; j <= num_cols; j++) {
-      size_t seat_ix = seat_index(event, i, j);
-      seats[seat_ix] = event->data[seat_ix];
+  size_t band_rows = num_rows < SEAT_TILE_ROWS ? num_rows : SEAT_TILE_ROWS;
+
+  // v1 sends the dimensions as size_t, v2 frames them as uint32_t along with every seat
+  int ret_value = 0;
+  char header[sizeof(struct FrameHeader) + sizeof(int) + 2 * sizeof(size_t)];
+  char *ptr = header;
+  if (request != NULL) {
+    size_t length = sizeof(int) + 2 * sizeof(uint32_t) + num_rows * num_cols * sizeof(uint32_t);
+    if (num_rows > UINT32_MAX || num_cols > UINT32_MAX || length > UINT32_MAX) {
+      fprintf(stderr, "Event too large for a frame\n");
+      write_failure(out, request);
+      return 1;
     }
+    struct FrameHeader frame = {(uint32_t)length, request->opcode, request->request_id};
+    uint32_t dims[2] = {(uint32_t)num_rows, (uint32_t)num_cols};
+    memcpy(ptr, &frame, sizeof(frame));
+    ptr += sizeof(frame);
+    memcpy(ptr, &ret_value, sizeof(int));
+    ptr += sizeof(int);
+    memcpy(ptr, dims, sizeof(dims));
+    ptr += sizeof(dims);
+  } else {
+    memcpy(ptr, &ret_value, sizeof(int));
+    ptr += sizeof(int);
+    memcpy(ptr, &num_rows, sizeof(size_t));
+    ptr += sizeof(size_t);
+    memcpy(ptr, &num_cols, sizeof(size_t));
+    ptr += sizeof(size_t);
   }
 
-  pthread_mutex_unlock(&event->mutex);
-
-  ret_value = 0;
-  char response[sizeof(int) + 2 * sizeof(size_t) + sizeof(unsigned int) * num_rows * num_cols];
-  char *ptr = response;
+  int failed = outbox_append(out, header, (size_t)(ptr - header));
 
-  memcpy(ptr, &ret_value, sizeof(int));
-  ptr += sizeof(int);
-  memcpy(ptr, &num_rows, sizeof(size_t));
-  ptr += sizeof(size_t);
-  memcpy(ptr, &num_cols, sizeof(size_t));
-  ptr += sizeof(size_t);
-  memcpy(ptr, seats, sizeof(unsigned int) * num_rows * num_cols);
+  // The seats are copied one band at a time from the pinned version straight into the outbox, which writes
+  // them out as they build up when the pipe takes them
+  for (size_t row = 1; row <= num_rows && !failed; row += band_rows) {
+    size_t count = num_rows - row + 1 < band_rows ? num_rows - row + 1 : band_rows;
+    unsigned int* seats = outbox_reserve(out, count * num_cols * sizeof(unsigned int));
+    if (seats == NULL) {
+      failed = 1;
+      break;
+    }
+    seatmap_copy_rows(event, map, row, count, seats);
+  }
 
-  ssize_t ret_write = write(out_fd, response, sizeof(response));
-  if (ret_write == -1){
+  if (failed) {
     fprintf(stderr, "Error writing\n");
   }
   return ret_value;
 }
 
-int ems_list_events(int out_fd) {
-  int ret_value;
-  ssize_t ret;
+/// Position of an operation of a batch, sorted to group the operations on the same event.
+struct BatchSlot {
+  unsigned int event_id;  // Id of the event of the operation
+  size_t index;           // Index of the operation in the batch
+};
+
+/// Orders batch slots by event, keeping the order of the batch within each event.
+static int compare_slots(const void* a, const void* b) {
+  const struct BatchSlot* slot_a = a;
+  const struct BatchSlot* slot_b = b;
+  if (slot_a->event_id != slot_b->event_id) {
+    return (slot_a->event_id > slot_b->event_id) - (slot_a->event_id < slot_b->event_id);
+  }
+  return (slot_a->index > slot_b->index) - (slot_a->index < slot_b->index);
+}
 
-  if (event_list == NULL) {
+int ems_batch(struct Outbox* out, const struct BatchOp* ops, size_t num_ops, struct EventCache* cache,
+              const struct FrameHeader* request) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+    write_failure(out, request);
+    return 1;
+  }
+
+  // Operations on different events do not affect each other, so only their order within an event is kept
+  struct BatchSlot slots[num_ops > 0 ? num_ops : 1];
+  for (size_t i = 0; i < num_ops; i++) {
+    slots[i] = (struct BatchSlot){ops[i].event_id, i};
   }
+  qsort(slots, num_ops, sizeof(struct BatchSlot), compare_slots);
+
+  // The versions pinned by each SHOW are only printed once the whole batch ran, so they stay pinned until then
+  int results[num_ops > 0 ? num_ops : 1];
+  struct Event* shown[num_ops > 0 ? num_ops : 1];
+  const struct SeatMap* maps[num_ops > 0 ? num_ops : 1];
+  epoch_enter();
+
+  for (size_t start = 0; start < num_ops;) {
+    size_t end = start + 1;
+    while (end < num_ops && slots[end].event_id == slots[start].event_id) end++;
+
+    // The event is looked up and locked once for all its reservations, again only after a CREATE made it exist
+    struct Event* event = NULL;
+    int looked_up = 0, locked = 0;
+    for (size_t i = start; i < end; i++) {
+      const struct BatchOp* op = &ops[slots[i].index];
+      int* result = &results[slots[i].index];
+
+      if (op->opcode == OP_CREATE) {
+        if (locked) unlock_event(event);
+        locked = 0;
+        *result = ems_create(op->event_id, op->num_rows, op->num_cols);
+        if (event == NULL) looked_up = 0;
+        continue;
+      }
+
+      if (!looked_up) {
+        event = get_event_cached(cache, op->event_id);
+        looked_up = 1;
+      }
+      if (event == NULL) {
+        fprintf(stderr, "Event not found\n");
+        *result = 1;
+        continue;
+      }
+
+      // A SHOW sees every reservation that comes before it in the batch
+      if (op->opcode == OP_SHOW) {
+        shown[slots[i].index] = event;
+        maps[slots[i].index] = seatmap_pin(event);
+        *result = 0;
+        continue;
+      }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    ret_value = 1;
-    ret = write(out_fd, &ret_value, sizeof(int));
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
-    return ret_value;
+      if (!locked && lock_event(event) != 0) {
+        fprintf(stderr, "Error locking mutex\n");
+        *result = 1;
+        continue;
+      }
+      locked = 1;
+      *result = reserve_locked(event, op->num_seats, op->xs, op->ys);
+    }
+    if (locked) unlock_event(event);
+
+    start = end;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  // Response: result, then the result of each operation, then the response to each SHOW in the order of the batch
+  struct FrameHeader frame = {(uint32_t)((1 + num_ops) * sizeof(int)), request->opcode, request->request_id};
+  int ret_value = 0;
+  if (outbox_append(out, &frame, sizeof(frame)) != 0 || outbox_append(out, &ret_value, sizeof(int)) != 0 ||
+      outbox_append(out, results, num_ops * sizeof(int)) != 0) {
+    fprintf(stderr, "Failed to write\n");
+  }
 
-  size_t num_events = 0;
-  while (current != NULL) {
-    num_events++;
-    if (current == to) {
-        break;
+  struct FrameHeader show_request = {0, OP_SHOW, request->request_id};
+  for (size_t i = 0; i < num_ops; i++) {
+    if (ops[i].opcode != OP_SHOW) continue;
+    if (results[i] == 0) {
+      write_seats(out, shown[i], maps[i], &show_request);
+      seatmap_unpin(shown[i]);
+    } else {
+      write_failure(out, &show_request);
     }
-    current = current->next;
   }
+  epoch_exit();
 
-  ret_value = 0;
-  ret = write(out_fd, &ret_value, sizeof(int));
-  if (ret == -1) fprintf(stderr, "Failed to write\n");
+  return ret_value;
+}
 
-  ret = write(out_fd, &num_events, sizeof(size_t));
-  if (ret == -1) fprintf(stderr, "Failed to write\n");
+int ems_reserve_best(unsigned int event_id, size_t num_seats, int contiguous, size_t* xs, size_t* ys,
+                     unsigned int* reservation_id, struct EventCache* cache) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-  if (num_events != 0) {
-    unsigned int ids[num_events];
-    int i = 0;
-    current = event_list->head;
-    while (current != NULL) {
-        unsigned int event_id = (current->event)->id;
-        ids[i] = event_id;
-        if (current == to) {
-            break;
-        }
-        i++;
-        current = current->next;
+  epoch_enter();
+  struct Event* event = get_event_cached(cache, event_id);
+
+  if (event == NULL) {
+    epoch_exit();
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  if (lock_event(event) != 0) {
+    epoch_exit();
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  // Counting the bitmap a vector at a time is far cheaper than a search that cannot succeed
+  int not_found = occupancy_count_free(event) < num_seats;
+  if (!not_found && contiguous) {
+    size_t row, col;
+    not_found = occupancy_find_run(event, num_seats, &row, &col);
+    for (size_t i = 0; !not_found && i < num_seats; i++) {
+      xs[i] = row;
+      ys[i] = col + i;
     }
-    ret = write(out_fd, ids, sizeof(unsigned int) * num_events);
-    if (ret == -1) fprintf(stderr, "Failed to write\n");
+  } else if (!not_found) {
+    not_found = occupancy_find_free(event, num_seats, xs, ys);
   }
-  
-  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (not_found) {
+    unlock_event(event);
+    epoch_exit();
+    fprintf(stderr, "Not enough free seats\n");
+    return 1;
+  }
+
+  int ret_value = commit_seats(event, num_seats, xs, ys, reservation_id);
+
+  unlock_event(event);
+  epoch_exit();
   return ret_value;
 }
 
-int ems_show_all() {
-  if (event_list == NULL) {
-      fprintf(stderr, "EMS state must be initialized\n");
-      return 1;
+int ems_show(struct Outbox* out, unsigned int event_id, struct EventCache* cache, const struct FrameHeader* request) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    write_failure(out, request);
+    return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-      fprintf(stderr, "Error locking list rwl\n");
-      return 1;
+  epoch_enter();
+  struct Event* event = get_event_cached(cache, event_id);
+
+  if (event == NULL) {
+    epoch_exit();
+    fprintf(stderr, "Event not found\n");
+    write_failure(out, request);
+    return 1;
   }
 
-  struct ListNode* current = event_list->head;
+  int ret_value = write_seats(out, event, seatmap_pin(event), request);
+  seatmap_unpin(event);
+  epoch_exit();
+  return ret_value;
+}
 
-  while (current != NULL) {
-    unsigned int event_id = (current->event)->id;
+int ems_list_events(struct Outbox* out, const struct FrameHeader* request) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    write_failure(out, request);
+    return 1;
+  }
 
-    fprintf(stdout, "%u\n", event_id);
-    struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct Event** events;
+  size_t num_events;
+  if (collect_events(&events, &num_events) != 0) {
+    fprintf(stderr, "Error collecting events\n");
+    write_failure(out, request);
+    return 1;
+  }
 
-    if (event == NULL) {
-      fprintf(stderr, "Event not found\n");
-      return 1;
+  // v2 counts the events with a uint32_t
+  int ret_value = 0;
+  char header[sizeof(struct FrameHeader) + sizeof(int) + sizeof(size_t)];
+  char *ptr = header;
+  if (request != NULL) {
+    uint32_t count = (uint32_t)num_events;
+    struct FrameHeader frame = {(uint32_t)(sizeof(int) + sizeof(uint32_t) + num_events * sizeof(unsigned int)),
+                                request->opcode, request->request_id};
+    memcpy(ptr, &frame, sizeof(frame));
+    ptr += sizeof(frame);
+    memcpy(ptr, &ret_value, sizeof(int));
+    ptr += sizeof(int);
+    memcpy(ptr, &count, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+  } else {
+    memcpy(ptr, &ret_value, sizeof(int));
+    ptr += sizeof(int);
+    memcpy(ptr, &num_events, sizeof(size_t));
+    ptr += sizeof(size_t);
+  }
+
+  // The ids are written straight into the outbox after the header
+  int failed = outbox_append(out, header, (size_t)(ptr - header));
+  if (!failed && num_events > 0) {
+    unsigned int* ids = outbox_reserve(out, num_events * sizeof(unsigned int));
+    if (ids == NULL) {
+      failed = 1;
+    } else {
+      for (size_t i = 0; i < num_events; i++) {
+        ids[i] = events[i]->id;
+      }
     }
+  }
+  slab_free(events, num_events * sizeof(struct Event*));
 
-    if (pthread_mutex_lock(&event->mutex) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
+  if (failed) {
+    fprintf(stderr, "Failed to write\n");
+  }
+  return ret_value;
+}
+
+int ems_show_all() {
+  if (shards == NULL) {
+      fprintf(stderr, "EMS state must be initialized\n");
       return 1;
+  }
+
+  epoch_enter();
+  struct Event** events;
+  size_t num_events;
+  if (collect_events(&events, &num_events) != 0) {
+    epoch_exit();
+    fprintf(stderr, "Error collecting events\n");
+    return 1;
+  }
+
+  size_t maps_size = (num_events > 0 ? num_events : 1) * sizeof(struct SeatMap*);
+  const struct SeatMap** maps = slab_alloc(maps_size);
+  if (maps == NULL) {
+    epoch_exit();
+    fprintf(stderr, "Error allocating memory for seat maps\n");
+    slab_free(events, num_events * sizeof(struct Event*));
+    return 1;
+  }
+
+  // Every version is pinned before printing starts, so reservations made while printing are left out
+  for (size_t k = 0; k < num_events; k++) {
+    maps[k] = seatmap_pin(events[k]);
+  }
+
+  int ret_value = 0;
+  for (size_t k = 0; k < num_events && ret_value == 0; k++) {
+    struct Event* event = events[k];
+    if (print_uint(1, event->id) || print_str(1, "\n")) {
+      ret_value = 1;
+      break;
     }
 
-    size_t num_rows = event->rows;
-    size_t num_cols = event->cols;
-
-    for (size_t i = 1; i <= num_rows; i++) {
-      for (size_t j = 1; j <= num_cols; j++) {
-        char buffer[16];
-        sprintf(buffer, "%u", event->data[seat_index(event, i, j)]);
-
-        if (print_str(1, buffer)) {
-          fprintf(stderr, "Error writing to file descriptor");
-          pthread_mutex_unlock(&event->mutex);
-          return 1;
-        }
-        if (j < event->cols) {
-          if (print_str(1, " ")) {
-            fprintf(stderr, "Error writing to file descriptor");
-            pthread_mutex_unlock(&event->mutex);
-            return 1;
-          }
-        }
-      }      
-      if (print_str(1, "\n")) {
-        fprintf(stderr, "Error writing to file descriptor");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+    // Each band of rows is copied out of the tiles and rendered with a single write
+    size_t band_rows = event->rows < SEAT_TILE_ROWS ? event->rows : SEAT_TILE_ROWS;
+    size_t seats_size = band_rows * event->cols * sizeof(unsigned int);
+    unsigned int* seats = slab_alloc(seats_size);
+    if (seats == NULL) {
+      ret_value = 1;
+      break;
     }
-    pthread_mutex_unlock(&event->mutex);
-    if (print_str(1, "\n")) {
-      fprintf(stderr, "Error writing to file descriptor");
-      pthread_mutex_unlock(&event->mutex);
-      return 1;
+    for (size_t row = 1; row <= event->rows && ret_value == 0; row += band_rows) {
+      size_t count = event->rows - row + 1 < band_rows ? event->rows - row + 1 : band_rows;
+      seatmap_copy_rows(event, maps[k], row, count, seats);
+      ret_value = print_seats(1, seats, count, event->cols);
+    }
+    slab_free(seats, seats_size);
+
+    if (ret_value == 0 && print_str(1, "\n")) {
+      ret_value = 1;
     }
-    current = current->next;
   }
-  pthread_rwlock_unlock(&event_list->rwl);
-  return 0;
-}
\ No newline at end of file
+  for (size_t k = 0; k < num_events; k++) {
+    seatmap_unpin(events[k]);
+  }
+  epoch_exit();
+
+  if (ret_value != 0) {
+    fprintf(stderr, "Error writing to file descriptor");
+  }
+  slab_free(maps, maps_size);
+  slab_free(events, num_events * sizeof(struct Event*));
+  return ret_value;
+}
+
+void ems_cache_reset(struct EventCache* cache) {
+  for (size_t i = 0; i < EVENT_CACHE_SIZE; i++) {
+    cache->events[i] = NULL;
+  }
+  cache->next = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+}
@@ -3,10 +3,28 @@
 
 #include <stddef.h>
 
+#include "common/constants.h"
+
+struct BatchOp;
+struct Event;
+struct FrameHeader;
+struct Outbox;
+
+// Small per-session cache of event handles, so repeated operations on the same
+// event skip the costly state lookup.
+struct EventCache {
+  unsigned int ids[EVENT_CACHE_SIZE];      // Ids of the cached events
+  struct Event* events[EVENT_CACHE_SIZE];  // Cached events, NULL for empty entries
+  size_t next;                             // Entry to be replaced on the next miss
+  size_t hits;                             // Number of lookups served by the cache
+  size_t misses;                           // Number of lookups that went to the store
+};
+
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
+/// @param shard_count Number of shards the events are split into.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
-int ems_init(unsigned int delay_us);
+int ems_init(unsigned int delay_us, size_t shard_count);
 
 /// Destroys the EMS state.
 int ems_terminate();
@@ -20,22 +38,56 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
-/// @param num_seats Number of seats to reserve.
+/// @param num_seats Number of seats to reserve, from 1 to MAX_RESERVATION_SIZE.
 /// @param xs Array of rows of the seats to reserve.
 /// @param ys Array of columns of the seats to reserve.
+/// @param cache Event cache of the calling session, may be NULL.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys, struct EventCache *cache);
+
+/// Runs a batch of CREATE, RESERVE and SHOW operations and answers it with the result of each one, followed by
+/// the answer to each SHOW.
+/// @note Operations are grouped by event, so each event is looked up and locked once for the whole batch.
+/// Operations on the same event run in the order of the batch, those on different events in any order.
+/// @param out Outbox to queue the answer in.
+/// @param ops Array of operations to run.
+/// @param num_ops Number of operations.
+/// @param cache Event cache of the calling session, may be NULL.
+/// @param request Request being answered.
+/// @return 0 if the batch was run, 1 otherwise.
+int ems_batch(struct Outbox *out, const struct BatchOp *ops, size_t num_ops, struct EventCache *cache,
+              const struct FrameHeader *request);
+
+/// Creates a new reservation on the best seats available in the given event.
+/// @note Seats are picked from the front rows first, then from the left.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param contiguous Whether the seats must be side by side in a single row.
+/// @param xs Array to store the rows of the reserved seats in.
+/// @param ys Array to store the columns of the reserved seats in.
+/// @param reservation_id Pointer to the variable to store the reservation id in.
+/// @param cache Event cache of the calling session, may be NULL.
 /// @return 0 if the reservation was created successfully, 1 otherwise.
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+int ems_reserve_best(unsigned int event_id, size_t num_seats, int contiguous, size_t *xs, size_t *ys,
+                     unsigned int *reservation_id, struct EventCache *cache);
 
 /// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
+/// @param out Outbox to queue the answer in.
 /// @param event_id Id of the event to print.
+/// @param cache Event cache of the calling session, may be NULL.
+/// @param request Request being answered in protocol v2, NULL in protocol v1.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(int out_fd, unsigned int event_id);
+int ems_show(struct Outbox *out, unsigned int event_id, struct EventCache *cache, const struct FrameHeader *request);
+
+/// Empties an event cache and resets its counters.
+/// @param cache Event cache to be reset.
+void ems_cache_reset(struct EventCache *cache);
 
 /// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
+/// @param out Outbox to queue the answer in.
+/// @param request Request being answered in protocol v2, NULL in protocol v1.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int out_fd);
+int ems_list_events(struct Outbox *out, const struct FrameHeader *request);
 
 /// Prints all the events and their seats
 /// @return 0 if the events were printed successfully, 1 otherwise.
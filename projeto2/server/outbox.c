@@ -0,0 +1,89 @@
+#include "outbox.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "slab.h"
+
+void outbox_init(struct Outbox *out, int fd) {
+  out->fd = fd;
+  out->data = NULL;
+  out->start = 0;
+  out->end = 0;
+  out->capacity = 0;
+}
+
+void outbox_destroy(struct Outbox *out) {
+  slab_free(out->data, out->capacity);
+  outbox_init(out, -1);
+}
+
+void outbox_reset(struct Outbox *out, int fd) {
+  out->fd = fd;
+  out->start = 0;
+  out->end = 0;
+}
+
+void *outbox_reserve(struct Outbox *out, size_t len) {
+  if (out->end - out->start >= OUTBOX_FLUSH_SIZE && outbox_flush(out) != 0) {
+    return NULL;
+  }
+
+  // Written bytes are dropped from the front before the buffer grows
+  if (out->start > 0 && len > out->capacity - out->end) {
+    memmove(out->data, out->data + out->start, out->end - out->start);
+    out->end -= out->start;
+    out->start = 0;
+  }
+  if (out->data == NULL || len > out->capacity - out->end) {
+    size_t capacity = out->capacity > 0 ? out->capacity : OUTBOX_FLUSH_SIZE;
+    while (capacity - out->end < len) {
+      capacity *= 2;
+    }
+    // Up to SLAB_MAX_OBJECT the buffers come from the size classes, so growing one does not reach malloc
+    char *data = slab_alloc(capacity);
+    if (data == NULL) {
+      return NULL;
+    }
+    if (out->data != NULL) {
+      memcpy(data, out->data, out->end);
+      slab_free(out->data, out->capacity);
+    }
+    out->data = data;
+    out->capacity = capacity;
+  }
+
+  void *queued = out->data + out->end;
+  out->end += len;
+  return queued;
+}
+
+int outbox_append(struct Outbox *out, const void *data, size_t len) {
+  void *queued = outbox_reserve(out, len);
+  if (queued == NULL) {
+    return 1;
+  }
+  memcpy(queued, data, len);
+  return 0;
+}
+
+int outbox_flush(struct Outbox *out) {
+  while (out->start < out->end) {
+    ssize_t written = write(out->fd, out->data + out->start, out->end - out->start);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      return 1;
+    }
+    out->start += (size_t)written;
+  }
+
+  out->start = 0;
+  out->end = 0;
+  return 0;
+}
+
+size_t outbox_pending(const struct Outbox *out) { return out->end - out->start; }
@@ -0,0 +1,55 @@
+#ifndef SERVER_OUTBOX_H
+#define SERVER_OUTBOX_H
+
+#include <stddef.h>
+
+/// Answers queued for a response pipe. They are written once OUTBOX_FLUSH_SIZE bytes build up or the caller
+/// flushes. On a blocking pipe a flush writes everything, so the outbox stays small. On a non-blocking pipe
+/// whatever does not fit stays queued, in order, until the next flush.
+struct Outbox {
+  int fd;           // File descriptor the answers are written to
+  char *data;       // Queued bytes, the unsent ones from start to end
+  size_t start;     // Index of the first byte not written yet
+  size_t end;       // Number of bytes in the buffer
+  size_t capacity;  // Bytes allocated, doubled when full
+};
+
+/// Initializes an empty outbox with no memory.
+/// @param out The outbox to initialize.
+/// @param fd File descriptor to write to.
+void outbox_init(struct Outbox *out, int fd);
+
+/// Frees the memory of an outbox, dropping anything not written.
+/// @param out The outbox to destroy.
+void outbox_destroy(struct Outbox *out);
+
+/// Drops anything not written and points the outbox to another file descriptor, keeping its memory.
+/// @param out The outbox to reset.
+/// @param fd File descriptor to write to.
+void outbox_reset(struct Outbox *out, int fd);
+
+/// Makes room for bytes at the end of the outbox and queues them. Queued bytes are flushed first once there are
+/// at least OUTBOX_FLUSH_SIZE of them.
+/// @param out The outbox to queue in.
+/// @param len Number of bytes to queue.
+/// @return Pointer to the queued bytes, to be filled by the caller before the next call, NULL on error.
+void *outbox_reserve(struct Outbox *out, size_t len);
+
+/// Queues bytes at the end of the outbox.
+/// @param out The outbox to queue in.
+/// @param data Bytes to queue.
+/// @param len Number of bytes.
+/// @return 0 if the bytes were queued, 1 on error.
+int outbox_append(struct Outbox *out, const void *data, size_t len);
+
+/// Writes as many queued bytes as the file descriptor takes.
+/// @param out The outbox to flush.
+/// @return 0 if everything was written or the rest would block, see outbox_pending, 1 on error.
+int outbox_flush(struct Outbox *out);
+
+/// Gets the number of queued bytes not written yet.
+/// @param out The outbox.
+/// @return Number of bytes pending.
+size_t outbox_pending(const struct Outbox *out);
+
+#endif  // SERVER_OUTBOX_H
@@ -14,13 +14,14 @@
 #include "operations.h"
 #include "common/constants.h"
 #include "pathQueue.h"
+#include "slab.h"
 
 PathQueue pathQueue = {NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
 
 void enqueue_path(const char* path) {
   pthread_mutex_lock(&pathQueue.mutex);
 
-  PathNode* newNode = (PathNode*)malloc(sizeof(PathNode));
+  PathNode* newNode = slab_alloc(sizeof(PathNode));
   if (newNode == NULL) {
     perror("Failed to allocate memory for path node");
     exit(EXIT_FAILURE);
@@ -42,13 +43,13 @@ void enqueue_path(const char* path) {
   pthread_mutex_unlock(&pathQueue.mutex);
 }
 
-char* dequeue_path() {
+void dequeue_path(char* path, size_t size) {
   PathNode* node = pathQueue.head;
   pathQueue.head = node->next;
 
-  char* path = strdup(node->path);
-  free(node);
-  return path;
+  strncpy(path, node->path, size - 1);
+  path[size - 1] = '\0';
+  slab_free(node, sizeof(PathNode));
 }
 
 void free_path_queue() {
@@ -57,7 +58,7 @@ void free_path_queue() {
   while (pathQueue.head != NULL) {
     PathNode* node = pathQueue.head;
     pathQueue.head = node->next;
-    free(node);
+    slab_free(node, sizeof(PathNode));
   }
 
   pthread_mutex_unlock(&pathQueue.mutex);
@@ -23,8 +23,10 @@ extern PathQueue pathQueue;
 void enqueue_path(const char* path);
 
 /// Dequeues a path from the queue
-/// @return the dequeued path string
-char* dequeue_path();
+/// @note The caller must hold the queue mutex and the queue must not be empty
+/// @param path buffer to copy the dequeued path to
+/// @param size size of the buffer
+void dequeue_path(char* path, size_t size);
 
 /// Frees the queue
 void free_path_queue();
@@ -0,0 +1,341 @@
+#include "seatmap.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/constants.h"
+#include "epoch.h"
+#include "slab.h"
+
+// A striped reservation owns every band of its stripes, so no two writers ever copy the same band
+_Static_assert(STRIPE_ROWS % SEAT_TILE_ROWS == 0, "stripes must be made of whole seat bands");
+
+#define TILE_SEATS (SEAT_TILE_ROWS * SEAT_TILE_COLS)
+
+/// Width specialized accessors for the seats of a tile.
+struct TileKernels {
+  unsigned int (*get)(const void* tile, size_t offset);
+  void (*set)(void* tile, size_t offset, unsigned int value);
+  void (*read)(const void* tile, size_t offset, size_t count, unsigned int* out);
+};
+
+// Defines the kernels for seats stored as uint<bits>_t
+#define DEFINE_TILE_KERNELS(bits)                                                                     \
+  static unsigned int tile_get_##bits(const void* tile, size_t offset) {                              \
+    return ((const uint##bits##_t*)tile)[offset];                                                     \
+  }                                                                                                   \
+  static void tile_set_##bits(void* tile, size_t offset, unsigned int value) {                        \
+    ((uint##bits##_t*)tile)[offset] = (uint##bits##_t)value;                                          \
+  }                                                                                                   \
+  static void tile_read_##bits(const void* tile, size_t offset, size_t count, unsigned int* out) {    \
+    const uint##bits##_t* seats = (const uint##bits##_t*)tile + offset;                               \
+    for (size_t i = 0; i < count; i++) {                                                              \
+      out[i] = seats[i];                                                                              \
+    }                                                                                                 \
+  }
+
+DEFINE_TILE_KERNELS(8)
+DEFINE_TILE_KERNELS(16)
+DEFINE_TILE_KERNELS(32)
+
+// Indexed by width / 2: 1 byte, 2 bytes, 4 bytes
+static const struct TileKernels kernels[] = {
+    {tile_get_8, tile_set_8, tile_read_8},
+    {tile_get_16, tile_set_16, tile_read_16},
+    {tile_get_32, tile_set_32, tile_read_32},
+};
+
+/// Gets the size of a version of a seat map.
+/// @param num_bands Number of bands of the seat map.
+/// @return Bytes taken by the version, without its bands.
+static size_t map_size(size_t num_bands) { return sizeof(struct SeatMap) + num_bands * sizeof(void**); }
+
+/// Gets the size of a band.
+/// @param map Version the band belongs to.
+/// @return Bytes taken by the tile pointers and widths of the band.
+static size_t band_size(const struct SeatMap* map) { return map->num_tiles * (sizeof(void*) + 1); }
+
+/// Gets the widths of the tiles of a band.
+/// @param map Version the band belongs to.
+/// @param band Band to access.
+/// @return Bytes per seat of each tile of the band, 0 for tiles not allocated.
+static unsigned char* band_widths(const struct SeatMap* map, void* const* band) {
+  return (unsigned char*)(band + map->num_tiles);
+}
+
+/// Gets the narrowest width that can store a reservation id.
+/// @param reservation_id Reservation id to store.
+/// @return Bytes per seat needed.
+static size_t width_for(unsigned int reservation_id) {
+  if (reservation_id <= UINT8_MAX) return 1;
+  if (reservation_id <= UINT16_MAX) return 2;
+  return 4;
+}
+
+/// Gets the offset of a seat inside its tile.
+/// @param row Row of the seat (1-based).
+/// @param col Column of the seat (1-based).
+/// @return Offset of the seat in its tile.
+static size_t tile_offset(size_t row, size_t col) {
+  return ((row - 1) % SEAT_TILE_ROWS) * SEAT_TILE_COLS + (col - 1) % SEAT_TILE_COLS;
+}
+
+/// Allocates a band, copying the tile pointers and widths of an existing one.
+/// @param map Version the band belongs to.
+/// @param band Band to copy, NULL for an empty band.
+/// @return Newly allocated band, NULL on failure.
+static void** copy_band(const struct SeatMap* map, void* const* band) {
+  void** copy = slab_alloc(band_size(map));
+  if (copy == NULL) return NULL;
+
+  if (band != NULL) {
+    memcpy(copy, band, band_size(map));
+  } else {
+    memset(copy, 0, band_size(map));
+  }
+  return copy;
+}
+
+/// Allocates a tile, copying the seats of an existing one and promoting them if it is wider.
+/// @param tile Tile to copy, NULL for an empty tile.
+/// @param tile_width Bytes per seat of tile.
+/// @param width Bytes per seat of the copy, at least tile_width.
+/// @return Newly allocated tile, NULL on failure.
+static void* copy_tile(const void* tile, size_t tile_width, size_t width) {
+  void* copy = slab_alloc(TILE_SEATS * width);
+  if (copy == NULL) return NULL;
+
+  if (tile == NULL) {
+    memset(copy, 0, TILE_SEATS * width);
+  } else if (tile_width == width) {
+    memcpy(copy, tile, TILE_SEATS * width);
+  } else {
+    const struct TileKernels* from = &kernels[tile_width / 2];
+    const struct TileKernels* to = &kernels[width / 2];
+    for (size_t i = 0; i < TILE_SEATS; i++) {
+      to->set(copy, i, from->get(tile, i));
+    }
+  }
+  return copy;
+}
+
+int seatmap_init(struct Event* event) {
+  size_t num_bands = (event->rows + SEAT_TILE_ROWS - 1) / SEAT_TILE_ROWS;
+  struct SeatMap* map = slab_alloc(map_size(num_bands));
+  if (map == NULL) return 1;
+
+  map->num_bands = num_bands;
+  map->num_tiles = (event->cols + SEAT_TILE_COLS - 1) / SEAT_TILE_COLS;
+  for (size_t i = 0; i < num_bands; i++) {
+    map->bands[i] = NULL;
+  }
+
+  atomic_init(&event->seats, map);
+  return 0;
+}
+
+void seatmap_free(struct Event* event) {
+  struct SeatMap* map = atomic_load(&event->seats);
+  if (map == NULL) return;
+
+  for (size_t i = 0; i < map->num_bands; i++) {
+    if (map->bands[i] == NULL) continue;
+    unsigned char* widths = band_widths(map, map->bands[i]);
+    for (size_t j = 0; j < map->num_tiles; j++) {
+      slab_free(map->bands[i][j], TILE_SEATS * widths[j]);
+    }
+    slab_free(map->bands[i], band_size(map));
+  }
+  slab_free(map, map_size(map->num_bands));
+}
+
+const struct SeatMap* seatmap_pin(struct Event* event) {
+  // Reservations check for pins after counting themselves, so either they see this pin and copy, or it sees them
+  atomic_fetch_add(&event->readers, 1);
+  while (atomic_load(&event->writers) > 0) {
+    sched_yield();
+  }
+  return atomic_load_explicit(&event->seats, memory_order_acquire);
+}
+
+void seatmap_unpin(struct Event* event) { atomic_fetch_sub_explicit(&event->readers, 1, memory_order_release); }
+
+unsigned int seatmap_get(const struct SeatMap* map, size_t row, size_t col) {
+  void* const* band = map->bands[(row - 1) / SEAT_TILE_ROWS];
+  if (band == NULL) return 0;
+
+  size_t t = (col - 1) / SEAT_TILE_COLS;
+  if (band[t] == NULL) return 0;
+  return kernels[band_widths(map, band)[t] / 2].get(band[t], tile_offset(row, col));
+}
+
+void seatmap_copy_rows(const struct Event* event, const struct SeatMap* map, size_t first_row, size_t num_rows,
+                       unsigned int* seats) {
+  for (size_t row = first_row; row < first_row + num_rows; row++) {
+    unsigned int* out = seats + (row - first_row) * event->cols;
+    void* const* band = map->bands[(row - 1) / SEAT_TILE_ROWS];
+    if (band == NULL) {
+      memset(out, 0, event->cols * sizeof(unsigned int));
+      continue;
+    }
+
+    // Each tile holds a run of SEAT_TILE_COLS seats of the row, the last one may be cut short
+    const unsigned char* widths = band_widths(map, band);
+    for (size_t t = 0; t < map->num_tiles; t++) {
+      size_t first_col = t * SEAT_TILE_COLS;
+      size_t count = event->cols - first_col < SEAT_TILE_COLS ? event->cols - first_col : SEAT_TILE_COLS;
+      if (band[t] != NULL) {
+        kernels[widths[t] / 2].read(band[t], tile_offset(row, first_col + 1), count, out + first_col);
+      } else {
+        memset(out + first_col, 0, count * sizeof(unsigned int));
+      }
+    }
+  }
+}
+
+/// Assigns seats to a reservation in the current version of a seat map, without publishing a new one.
+/// @note Only called while no version is pinned. Tiles that are missing or too narrow are replaced inside their
+/// band, which the caller owns, but the bands themselves must already be allocated.
+/// @param map Current version of the seat map, with a band for every seat.
+/// @param num_seats Number of seats to assign.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @param reservation_id Reservation id to assign to the seats.
+/// @return 0 if the seats were assigned successfully, 1 otherwise.
+static int write_in_place(struct SeatMap* map, size_t num_seats, size_t* xs, size_t* ys, unsigned int reservation_id) {
+  // Every tile is made wide enough before any seat is set, so a failed allocation leaves the reservation out
+  for (size_t i = 0; i < num_seats; i++) {
+    void** band = map->bands[(xs[i] - 1) / SEAT_TILE_ROWS];
+    unsigned char* widths = band_widths(map, band);
+    size_t t = (ys[i] - 1) / SEAT_TILE_COLS;
+    if (band[t] != NULL && widths[t] >= width_for(reservation_id)) continue;
+
+    void* tile = copy_tile(band[t], widths[t], width_for(reservation_id));
+    if (tile == NULL) return 1;
+    if (band[t] != NULL) epoch_retire(band[t], TILE_SEATS * widths[t]);
+    band[t] = tile;
+    widths[t] = (unsigned char)width_for(reservation_id);
+  }
+
+  for (size_t i = 0; i < num_seats; i++) {
+    void** band = map->bands[(xs[i] - 1) / SEAT_TILE_ROWS];
+    size_t t = (ys[i] - 1) / SEAT_TILE_COLS;
+    kernels[band_widths(map, band)[t] / 2].set(band[t], tile_offset(xs[i], ys[i]), reservation_id);
+  }
+  return 0;
+}
+
+int seatmap_write(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, unsigned int reservation_id) {
+  struct SeatMap* current = atomic_load_explicit(&event->seats, memory_order_acquire);
+
+  // Unpinned versions are written in place, unless a band is missing: the band pointers are shared with
+  // reservations on other stripes, which may be publishing a new version with a copy of them
+  int in_place = 1;
+  for (size_t i = 0; i < num_seats && in_place; i++) {
+    in_place = current->bands[(xs[i] - 1) / SEAT_TILE_ROWS] != NULL;
+  }
+  // Once a reader is pinned, reservations go straight to copying and never count as writers, so the reader only
+  // waits for the in-place writes that started before it was
+  if (in_place && atomic_load(&event->readers) == 0) {
+    atomic_fetch_add(&event->writers, 1);
+    if (atomic_load(&event->readers) == 0) {
+      current = atomic_load_explicit(&event->seats, memory_order_acquire);
+      int ret_value = write_in_place(current, num_seats, xs, ys, reservation_id);
+      atomic_fetch_sub_explicit(&event->writers, 1, memory_order_release);
+      return ret_value;
+    }
+    atomic_fetch_sub_explicit(&event->writers, 1, memory_order_release);
+  }
+
+  struct SeatMap* next = slab_alloc(map_size(current->num_bands));
+  if (next == NULL) return 1;
+  next->num_bands = current->num_bands;
+  next->num_tiles = current->num_tiles;
+
+  // Copy every touched band and tile once, the caller owns them so they cannot change under us
+  size_t band_ix[num_seats];
+  void** bands[num_seats];
+  size_t num_bands = 0;
+  size_t tile_band[num_seats];
+  size_t tile_ix[num_seats];
+  void* old_tiles[num_seats];
+  size_t old_widths[num_seats];
+  size_t num_tiles = 0;
+  int failed = 0;
+
+  for (size_t i = 0; i < num_seats && !failed; i++) {
+    size_t b = (xs[i] - 1) / SEAT_TILE_ROWS;
+    size_t t = (ys[i] - 1) / SEAT_TILE_COLS;
+
+    size_t k = 0;
+    while (k < num_bands && band_ix[k] != b) {
+      k++;
+    }
+    if (k == num_bands) {
+      bands[k] = copy_band(current, current->bands[b]);
+      if (bands[k] == NULL) {
+        failed = 1;
+        break;
+      }
+      band_ix[k] = b;
+      num_bands++;
+    }
+
+    unsigned char* widths = band_widths(next, bands[k]);
+    size_t m = 0;
+    while (m < num_tiles && (tile_band[m] != k || tile_ix[m] != t)) {
+      m++;
+    }
+    if (m == num_tiles) {
+      size_t width = widths[t] > width_for(reservation_id) ? widths[t] : width_for(reservation_id);
+      void* tile = copy_tile(bands[k][t], widths[t], width);
+      if (tile == NULL) {
+        failed = 1;
+        break;
+      }
+      old_tiles[m] = bands[k][t];
+      old_widths[m] = widths[t];
+      bands[k][t] = tile;
+      widths[t] = (unsigned char)width;
+      tile_band[m] = k;
+      tile_ix[m] = t;
+      num_tiles++;
+    }
+
+    kernels[widths[t] / 2].set(bands[k][t], tile_offset(xs[i], ys[i]), reservation_id);
+  }
+
+  if (failed) {
+    for (size_t m = 0; m < num_tiles; m++) {
+      void** band = bands[tile_band[m]];
+      slab_free(band[tile_ix[m]], TILE_SEATS * band_widths(next, band)[tile_ix[m]]);
+    }
+    for (size_t k = 0; k < num_bands; k++) {
+      slab_free(bands[k], band_size(next));
+    }
+    slab_free(next, map_size(next->num_bands));
+    return 1;
+  }
+
+  // Writers on other stripes may publish first, then only the band pointers need to be taken again
+  do {
+    memcpy(next->bands, current->bands, current->num_bands * sizeof(void**));
+    for (size_t k = 0; k < num_bands; k++) {
+      next->bands[band_ix[k]] = bands[k];
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&event->seats, &current, next, memory_order_acq_rel,
+                                                  memory_order_acquire));
+
+  // The replaced version still holds the old touched bands and tiles, everything else lives on in next
+  for (size_t m = 0; m < num_tiles; m++) {
+    if (old_tiles[m] != NULL) epoch_retire(old_tiles[m], TILE_SEATS * old_widths[m]);
+  }
+  for (size_t k = 0; k < num_bands; k++) {
+    if (current->bands[band_ix[k]] != NULL) epoch_retire(current->bands[band_ix[k]], band_size(current));
+  }
+  epoch_retire(current, map_size(current->num_bands));
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SERVER_SEATMAP_H
+#define SERVER_SEATMAP_H
+
+#include <stddef.h>
+
+#include "eventlist.h"
+
+/// Multi-version, sparse seat maps.
+/// The seats are stored in tiles of SEAT_TILE_ROWS x SEAT_TILE_COLS, grouped in bands of SEAT_TILE_ROWS rows.
+/// Tiles and bands are only allocated once a seat in them is reserved, until then they read as free seats.
+/// Each tile stores its reservation ids in 1, 2 or 4 bytes per seat, the narrowest that fits the largest id
+/// written to it, and is promoted to a wider copy when a larger id comes along.
+/// While a reader has a version pinned, every reservation publishes a new version of the seat map that shares
+/// all the bands and tiles it did not touch with the previous one. Pinned versions are never modified, so readers
+/// see a consistent seat map without taking any lock. While no reader is pinned, reservations write the current
+/// version in place, copying only bands that were never allocated.
+
+/// Allocates the first, empty, version of the seat map of an event and stores it in the event.
+/// @param event Event with rows and cols already set.
+/// @return 0 if the seat map was allocated successfully, 1 otherwise.
+int seatmap_init(struct Event* event);
+
+/// Frees the current version of the seat map of an event.
+/// @note Older versions are freed by epoch_retire as they are replaced.
+/// @param event Event to be modified.
+void seatmap_free(struct Event* event);
+
+/// Pins the current version of the seat map of an event, waiting for reservations writing it in place.
+/// @note The wait is bounded: only reservations that were already writing in place when the pin was announced are
+/// waited for, each setting at most MAX_RESERVATION_SIZE seats, and every later one copies instead.
+/// @note The caller must be inside an epoch until it is done with the version, then call seatmap_unpin.
+/// @param event Event to read.
+/// @return Current version of the seat map.
+const struct SeatMap* seatmap_pin(struct Event* event);
+
+/// Releases a version pinned with seatmap_pin, once no pin is left reservations write in place again.
+/// @param event Event that was read.
+void seatmap_unpin(struct Event* event);
+
+/// Gets the reservation of a seat in a version of the seat map.
+/// @note This function assumes that the seat exists.
+/// @param map Pinned version of the seat map.
+/// @param row Row of the seat (1-based).
+/// @param col Column of the seat (1-based).
+/// @return Reservation id of the seat, 0 if it is free.
+unsigned int seatmap_get(const struct SeatMap* map, size_t row, size_t col);
+
+/// Copies consecutive rows of a version of the seat map to a flat array.
+/// @param event Event the version belongs to.
+/// @param map Pinned version of the seat map.
+/// @param first_row First row to copy (1-based).
+/// @param num_rows Number of rows to copy.
+/// @param seats Array of size num_rows * cols to copy the seats to.
+void seatmap_copy_rows(const struct Event* event, const struct SeatMap* map, size_t first_row, size_t num_rows,
+                       unsigned int* seats);
+
+/// Assigns seats to a reservation, in the current version of the seat map or in a new one if it is pinned.
+/// @note The caller must be inside an epoch and hold the stripes of every row touched, or the whole event,
+/// so no one else writes the same bands and tiles. Reservations on other stripes may write concurrently.
+/// @param event Event to be modified.
+/// @param num_seats Number of seats to assign.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @param reservation_id Reservation id to assign to the seats.
+/// @return 0 if the seats were assigned successfully, 1 otherwise.
+int seatmap_write(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, unsigned int reservation_id);
+
+#endif  // SERVER_SEATMAP_H
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,10 +13,301 @@
 #include "common/io.h"
 #include "eventlist.h"
 #include "common/constants.h"
+#include "common/protocol.h"
 #include "sessionFn.h"
 #include "operations.h"
+#include "outbox.h"
+#include "slab.h"
 
 
+/// Writes the answers queued so far, as many as the response pipe takes.
+/// @param session the session to flush
+/// @return 0 if the answers were written or the rest would block, 1 on error
+static int flush_replies(Session* session) {
+    if (outbox_flush(&session->replies) != 0) {
+        fprintf(stderr, "Session %d: failed to write\n", session->session_id);
+        return 1;
+    }
+    return 0;
+}
+
+/// Queues a v2 reply. Replies to requests that arrived together go out together once the session runs out of
+/// requests to serve, instead of with a write each.
+/// @param session the session of the request
+/// @param header the header of the request
+/// @param payload the payload of the reply
+/// @param length the number of bytes of payload
+static void queue_reply(Session* session, const struct FrameHeader* header, const void* payload, size_t length) {
+    struct FrameHeader reply = {(uint32_t)length, header->opcode, header->request_id};
+    char* queued = outbox_reserve(&session->replies, sizeof(reply) + length);
+    if (queued == NULL) {
+        fprintf(stderr, "Session %d: failed to queue reply\n", session->session_id);
+        return;
+    }
+
+    memcpy(queued, &reply, sizeof(reply));
+    memcpy(queued + sizeof(reply), payload, length);
+}
+
+void session_end(Session* session) {
+    // Whatever the response pipe does not take now is dropped with the session
+    flush_replies(session);
+    fprintf(stdout, "Session %d: %zu event cache hits, %zu misses\n", session->session_id,
+            session->cache.hits, session->cache.misses);
+#ifdef ALLOC_COUNT
+    slab_count_mallocs(NULL);
+    fprintf(stdout, "Session %d: %zu mallocs while serving requests\n", session->session_id, session->mallocs);
+#endif
+    fflush(stdout);
+    close(session->req_pipe);
+    close(session->resp_pipe);
+    outbox_reset(&session->replies, -1);
+    session->active = 0;
+}
+
+/// Answers a v2 request with just its result.
+/// @param session the session of the request
+/// @param header the header of the request
+/// @param res the result of the request
+static void reply_result(Session* session, const struct FrameHeader* header, int res) {
+    queue_reply(session, header, &res, sizeof(int));
+}
+
+/// Serves a BATCH, whose operations are decoded into a single array of coordinates and run together.
+/// The events shown by the batch are answered along with it.
+/// @param session the session of the request
+/// @param header the header of the request
+/// @param payload the fields of the request
+/// @param num_fields the number of fields of the request
+static void serve_batch(Session* session, const struct FrameHeader* header, const char* payload, size_t num_fields) {
+    size_t num_ops = num_fields >= 1 ? frame_field(payload, 0) : 0;
+    if (num_ops == 0 || num_ops > MAX_BATCH_SIZE) {
+        reply_result(session, header, 1);
+        return;
+    }
+
+    // Every coordinate is a field of its own, so the fields bound the coordinates of the whole batch
+    size_t coords_size = num_fields * sizeof(size_t);
+    size_t* coords = slab_alloc(coords_size);
+    if (coords == NULL) {
+        fprintf(stderr, "Error allocating memory for batch\n");
+        reply_result(session, header, 1);
+        return;
+    }
+
+    struct BatchOp ops[MAX_BATCH_SIZE];
+    size_t next = 1, used = 0;
+    int valid = 1;
+    for (size_t i = 0; i < num_ops; i++) {
+        struct BatchOp* op = &ops[i];
+        if (num_fields - next < 2) {
+            valid = 0;
+            break;
+        }
+        op->opcode = frame_field(payload, next);
+        op->event_id = frame_field(payload, next + 1);
+
+        if (op->opcode == OP_CREATE && num_fields - next >= 4) {
+            op->num_rows = frame_field(payload, next + 2);
+            op->num_cols = frame_field(payload, next + 3);
+            next += 4;
+        } else if (op->opcode == OP_SHOW) {
+            next += 2;
+        } else if (op->opcode == OP_RESERVE && num_fields - next >= 3) {
+            op->num_seats = frame_field(payload, next + 2);
+            if (op->num_seats == 0 || op->num_seats > MAX_RESERVATION_SIZE ||
+                num_fields - next - 3 < 2 * op->num_seats) {
+                valid = 0;
+                break;
+            }
+            op->xs = coords + used;
+            op->ys = coords + used + op->num_seats;
+            for (size_t j = 0; j < op->num_seats; j++) {
+                op->xs[j] = frame_field(payload, next + 3 + j);
+                op->ys[j] = frame_field(payload, next + 3 + op->num_seats + j);
+            }
+            used += 2 * op->num_seats;
+            next += 3 + 2 * op->num_seats;
+        } else {
+            valid = 0;
+            break;
+        }
+    }
+
+    if (valid && next == num_fields) {
+        ems_batch(&session->replies, ops, num_ops, &session->cache, header);
+    } else {
+        reply_result(session, header, 1);
+    }
+    slab_free(coords, coords_size);
+}
+
+/// Serves a request in protocol v2, whose fields are all uint32_t.
+/// @param session the session of the request
+/// @param header the header of the request
+/// @param payload the fields of the request
+static void serve_frame(Session* session, const struct FrameHeader* header, const char* payload) {
+    size_t num_fields = header->length / sizeof(uint32_t);
+    if (header->length % sizeof(uint32_t) != 0) {
+        reply_result(session, header, 1);
+        return;
+    }
+
+    switch (header->opcode) {
+        case OP_QUIT:
+            session_end(session);
+            break;
+        case OP_CREATE:
+            if (num_fields != 3) {
+                reply_result(session, header, 1);
+                break;
+            }
+            reply_result(session, header, ems_create(frame_field(payload, 0), frame_field(payload, 1),
+                                                     frame_field(payload, 2)));
+            break;
+        case OP_RESERVE: {
+            size_t num_seats = num_fields >= 2 ? frame_field(payload, 1) : 0;
+            if (num_seats == 0 || num_seats > MAX_RESERVATION_SIZE || num_fields != 2 + 2 * num_seats) {
+                reply_result(session, header, 1);
+                break;
+            }
+
+            size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+            for (size_t i = 0; i < num_seats; i++) {
+                xs[i] = frame_field(payload, 2 + i);
+                ys[i] = frame_field(payload, 2 + num_seats + i);
+            }
+            reply_result(session, header, ems_reserve(frame_field(payload, 0), num_seats, xs, ys, &session->cache));
+            break;
+        }
+        case OP_RESERVE_BEST: {
+            size_t num_seats = num_fields == 3 ? frame_field(payload, 1) : 0;
+            int res = 1;
+            unsigned int reservation_id = 0;
+            size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+            if (num_seats > 0 && num_seats <= MAX_RESERVATION_SIZE) {
+                res = ems_reserve_best(frame_field(payload, 0), num_seats, frame_field(payload, 2) != 0, xs, ys,
+                                       &reservation_id, &session->cache);
+            }
+            if (res != 0) {
+                reply_result(session, header, res);
+                break;
+            }
+
+            // Response: result, reservation id, number of seats, then their rows and columns
+            uint32_t response[3 + 2 * MAX_RESERVATION_SIZE];
+            response[0] = 0;
+            response[1] = reservation_id;
+            response[2] = (uint32_t)num_seats;
+            for (size_t i = 0; i < num_seats; i++) {
+                response[3 + i] = (uint32_t)xs[i];
+                response[3 + num_seats + i] = (uint32_t)ys[i];
+            }
+            queue_reply(session, header, response, (3 + 2 * num_seats) * sizeof(uint32_t));
+            break;
+        }
+        case OP_SHOW:
+            if (num_fields != 1) {
+                reply_result(session, header, 1);
+                break;
+            }
+            ems_show(&session->replies, frame_field(payload, 0), &session->cache, header);
+            break;
+        case OP_LIST:
+            ems_list_events(&session->replies, header);
+            break;
+        case OP_BATCH:
+            serve_batch(session, header, payload, num_fields);
+            break;
+        default:
+            fprintf(stderr, "Unknown OP_CODE: %u\n", header->opcode);
+            reply_result(session, header, 1);
+            break;
+    }
+}
+
+int session_start(Session* session) {
+    ems_cache_reset(&session->cache);
+    session->version = 1;
+    if (session->frames != NULL) {
+        frame_buffer_init(session->frames);
+    }
+    outbox_reset(&session->replies, session->resp_pipe);
+    if (outbox_append(&session->replies, &session->session_id, sizeof(int)) != 0 || flush_replies(session) != 0) {
+        return 1;
+    }
+#ifdef ALLOC_COUNT
+    session->mallocs = 0;
+#endif
+    session->active = 1;
+    return 0;
+}
+
+int session_open(Session* session) {
+    session->req_pipe = open(session->req_pipe_path, O_RDONLY);
+    if (session->req_pipe == -1) {
+        fprintf(stderr, "Failed to open request pipe\n");
+        return 1;
+    }
+    session->resp_pipe = open(session->resp_pipe_path, O_WRONLY);
+    if (session->resp_pipe == -1) {
+        fprintf(stderr, "Failed to open response pipe\n");
+        close(session->req_pipe);
+        return 1;
+    }
+    if (session_start(session) != 0) {
+        close(session->req_pipe);
+        close(session->resp_pipe);
+        return 1;
+    }
+    return 0;
+}
+
+int session_negotiate(Session* session, uint32_t version) {
+    // Every later request of the session is a frame of the version agreed on
+    uint32_t agreed = version < PROTOCOL_VERSION ? version : PROTOCOL_VERSION;
+    if (outbox_append(&session->replies, &agreed, sizeof(uint32_t)) != 0 || flush_replies(session) != 0) {
+        return 1;
+    }
+    session->version = (int)agreed;
+    return 0;
+}
+
+int session_serve_frames(Session* session) {
+    // Requests are taken from the buffer, which is only refilled once it holds no whole frame, so a client
+    // that pipelines its requests has them all served back to back and their replies sent at once
+    struct FrameHeader header;
+    const char* payload;
+    while (1) {
+        // Replies only build up so far, a client that does not read them is not served until it does
+        if (outbox_pending(&session->replies) >= OUTBOX_FLUSH_SIZE) {
+            if (flush_replies(session) != 0) {
+                session_end(session);
+                return 1;
+            }
+            if (outbox_pending(&session->replies) > 0) return 0;
+        }
+
+        int ret_frame = frame_next(session->frames, &header, &payload);
+        if (ret_frame == 1) {
+            serve_frame(session, &header, payload);
+            if (session->active == 0) return 1;
+            continue;
+        }
+
+        if (flush_replies(session) != 0) {
+            session_end(session);
+            return 1;
+        }
+        if (ret_frame == -1) {
+            fprintf(stderr, "Session %d: frame too large\n", session->session_id);
+            session_end(session);
+            return 1;
+        }
+        return 0;
+    }
+}
+
 void* session_fn(void* arg) {
     Session* session = (Session*) arg;
     char OP_CODE;
@@ -25,45 +317,40 @@ void* session_fn(void* arg) {
         fprintf(stderr, "Failed to block SIGUSR1\n");
         exit(EXIT_FAILURE);
     }
-    
+    outbox_init(&session->replies, -1);
+    // The thread serves its clients one after the other, so they all share a single request buffer
+    session->frames = malloc(sizeof(struct FrameBuffer));
+    if (session->frames == NULL) {
+        fprintf(stderr, "Error allocating memory for session\n");
+        exit(EXIT_FAILURE);
+    }
+    frame_buffer_init(session->frames);
+
     while(1){
         if (session->active == 0){
-            char* path;
             pthread_mutex_lock(&pathQueue.mutex);
             while (pathQueue.head == NULL) {
                 pthread_cond_wait(&pathQueue.not_empty, &pathQueue.mutex);
             }
-            path = dequeue_path();
-            if (path != NULL) {
-                strcpy(session->req_pipe_path, path);
-                free(path);
-            }
+            dequeue_path(session->req_pipe_path, sizeof(session->req_pipe_path));
             while (pathQueue.head == NULL) {
                 pthread_cond_wait(&pathQueue.not_empty, &pathQueue.mutex);
             }
-            path = dequeue_path();
-            if (path != NULL) {
-                strcpy(session->resp_pipe_path, path);
-                free(path);
-            }
+            dequeue_path(session->resp_pipe_path, sizeof(session->resp_pipe_path));
             pthread_mutex_unlock(&pathQueue.mutex);
 
-            session->req_pipe = open(session->req_pipe_path, O_RDONLY);
-            if (session->req_pipe == -1) {
-                fprintf(stderr, "Failed to open request pipe\n");
+            if (session_open(session) != 0) {
                 exit(EXIT_FAILURE);
             }
-            session->resp_pipe = open(session->resp_pipe_path, O_WRONLY);
-            if (session->resp_pipe == -1) {
-                fprintf(stderr, "Failed to open response pipe\n");
-                exit(EXIT_FAILURE);
-            }
-            ret = write(session->resp_pipe, &session->session_id, sizeof(int));
-            if (ret == -1) {
-                fprintf(stderr, "Failed to write for resp_pipe\n");
-                exit(EXIT_FAILURE);
+#ifdef ALLOC_COUNT
+            slab_count_mallocs(&session->mallocs);
+#endif
+
+        } else if (session->version >= 2) {
+            if (session_serve_frames(session) == 0 && frame_buffer_fill(session->frames, session->req_pipe) != 1) {
+                fprintf(stderr, "Session %d: request pipe closed\n", session->session_id);
+                session_end(session);
             }
-            session->active=1;
 
         } else if (session->active == 1){
             ret = read(session->req_pipe, &OP_CODE, sizeof(char));
@@ -73,10 +360,21 @@ void* session_fn(void* arg) {
             }
             switch(OP_CODE){
                 case '2': //quit
-                    close(session->req_pipe);
-                    close(session->resp_pipe);
-                    session->active = 0;
+                    session_end(session);
                     break;
+                case '8': { //version
+                    uint32_t version;
+                    ret = read(session->req_pipe, &version, sizeof(uint32_t));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to read version\n");
+                        exit(EXIT_FAILURE);
+                    }
+
+                    if (session_negotiate(session, version) != 0) {
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                }
                 case '3': { //create
                     unsigned int event_id;
                     size_t num_rows, num_cols;
@@ -130,21 +428,32 @@ void* session_fn(void* arg) {
                         exit(EXIT_FAILURE);
                     }
 
-                    size_t xs[num_seats];
+                    // The seats that follow cannot be skipped safely, so a session asking for too many is ended
+                    if (num_seats == 0 || num_seats > MAX_RESERVATION_SIZE) {
+                        fprintf(stderr, "Session %d: invalid number of seats\n", session->session_id);
+                        int res = 1;
+                        if (write(session->resp_pipe, &res, sizeof(int)) == -1) {
+                            fprintf(stderr, "Failed to write\n");
+                        }
+                        session_end(session);
+                        break;
+                    }
+
+                    size_t xs[MAX_RESERVATION_SIZE];
                     ret = read(session->req_pipe, xs, num_seats * sizeof(size_t));
                     if (ret == -1) {
                         fprintf(stderr, "Failed to read xs\n");
                         exit(EXIT_FAILURE);
                     }
 
-                    size_t ys[num_seats];
+                    size_t ys[MAX_RESERVATION_SIZE];
                     ret = read(session->req_pipe, ys, num_seats * sizeof(size_t));
                     if (ret == -1) {
                         fprintf(stderr, "Failed to read ys\n");
                         exit(EXIT_FAILURE);
                     }
 
-                    int res = ems_reserve(event_id, num_seats, xs, ys);
+                    int res = ems_reserve(event_id, num_seats, xs, ys, &session->cache);
                     ret = write(session->resp_pipe, &res, sizeof(int));
                     if (ret == -1) {
                         fprintf(stderr, "Failed to write\n");
@@ -152,6 +461,62 @@ void* session_fn(void* arg) {
                     }
                     break;
                 }
+                case '7': { //reserve best
+                    unsigned int event_id;
+                    int session_id, contiguous;
+                    size_t num_seats;
+                    ret = read(session->req_pipe, &session_id, sizeof(int));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to read session_id\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    ret = read(session->req_pipe, &event_id, sizeof(unsigned int));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to read event_id\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    ret = read(session->req_pipe, &num_seats, sizeof(size_t));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to read num_seats\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    ret = read(session->req_pipe, &contiguous, sizeof(int));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to read contiguous\n");
+                        exit(EXIT_FAILURE);
+                    }
+
+                    int res = 1;
+                    unsigned int reservation_id = 0;
+                    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+                    if (num_seats > 0 && num_seats <= MAX_RESERVATION_SIZE) {
+                        res = ems_reserve_best(event_id, num_seats, contiguous, xs, ys, &reservation_id,
+                                               &session->cache);
+                    }
+
+                    // Response: result, then the reservation id and the seats picked on success
+                    char response[sizeof(int) + sizeof(unsigned int) + sizeof(size_t) +
+                                  2 * MAX_RESERVATION_SIZE * sizeof(size_t)];
+                    char *ptr = response;
+                    memcpy(ptr, &res, sizeof(int));
+                    ptr += sizeof(int);
+                    if (res == 0) {
+                        memcpy(ptr, &reservation_id, sizeof(unsigned int));
+                        ptr += sizeof(unsigned int);
+                        memcpy(ptr, &num_seats, sizeof(size_t));
+                        ptr += sizeof(size_t);
+                        memcpy(ptr, xs, num_seats * sizeof(size_t));
+                        ptr += num_seats * sizeof(size_t);
+                        memcpy(ptr, ys, num_seats * sizeof(size_t));
+                        ptr += num_seats * sizeof(size_t);
+                    }
+                    ret = write(session->resp_pipe, response, (size_t)(ptr - response));
+                    if (ret == -1) {
+                        fprintf(stderr, "Failed to write\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                }
                 case '5': { //show
                     unsigned int event_id;
                     int session_id;
@@ -166,7 +531,10 @@ void* session_fn(void* arg) {
                         exit(EXIT_FAILURE);
                     }
 
-                    ems_show(session->resp_pipe, event_id);
+                    ems_show(&session->replies, event_id, &session->cache, NULL);
+                    if (flush_replies(session) != 0) {
+                        exit(EXIT_FAILURE);
+                    }
                     break;
                 }
                 case '6': { //list
@@ -176,7 +544,10 @@ void* session_fn(void* arg) {
                         fprintf(stderr, "Failed to read session_id\n");
                         exit(EXIT_FAILURE);
                     }
-                    ems_list_events(session->resp_pipe);
+                    ems_list_events(&session->replies, NULL);
+                    if (flush_replies(session) != 0) {
+                        exit(EXIT_FAILURE);
+                    }
                     break;
                 }
                 default:
@@ -2,7 +2,12 @@
 #define SERVER_SESSIONFN_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include "common/constants.h"
+#include "common/protocol.h"
+#include "operations.h"
+#include "outbox.h"
 
 typedef struct {
   int req_pipe;
@@ -11,8 +16,44 @@ typedef struct {
   int active;
   char resp_pipe_path[MAX_PIPE_NAME_SIZE];
   char req_pipe_path[MAX_PIPE_NAME_SIZE];
+  struct EventCache cache;          // Events this session operated on
+  int version;                      // Protocol version the client and the server agreed on
+  struct FrameBuffer* frames;       // Requests read ahead in protocol v2, NULL until the session needs it
+  struct Outbox replies;            // Answers queued for the response pipe, not written yet
+#if EVENT_LOOP
+  time_t open_deadline;  // Second of CLOCK_MONOTONIC the client must have opened its pipes by, 0 once checked
+#endif
+#ifdef ALLOC_COUNT
+  size_t mallocs;  // Calls to malloc made while serving the session, whichever thread served it
+#endif
 } Session;
 
+/// Sends the client of a session whose pipes are open its session id, starting the session in protocol v1.
+/// @param session the session to start, with its pipes and session id set
+/// @return 0 if the session was started successfully, 1 otherwise
+int session_start(Session* session);
+
+/// Opens the pipes at the paths of a session and sends the client its session id, starting the session in
+/// protocol v1.
+/// @param session the session to open, with its paths and session id set
+/// @return 0 if the session was opened successfully, 1 otherwise
+int session_open(Session* session);
+
+/// Answers the OP_VERSION of a v1 session and switches it to the version agreed on.
+/// @param session the session that asked for the version
+/// @param version the version the client asked for
+/// @return 0 if the version was agreed on successfully, 1 otherwise
+int session_negotiate(Session* session, uint32_t version);
+
+/// Serves every whole v2 frame buffered for a session, then writes the replies queued for them.
+/// @param session the session to serve
+/// @return 0 if the session waits for more requests, 1 if it ended
+int session_serve_frames(Session* session);
+
+/// Ends the session of a client that quit, printing its statistics and closing its pipes.
+/// @param session the session to end
+void session_end(Session* session);
+
 /// The session thread function that reads and writes from the client's pipes
 /// @param arg the thread's arguments
 void* session_fn(void* arg);
@@ -0,0 +1,184 @@
+#include "slab.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/constants.h"
+
+#define MIN_OBJECT 16
+#define NUM_CLASSES 13  // 16 bytes up to SLAB_MAX_OBJECT
+
+_Static_assert((size_t)MIN_OBJECT << (NUM_CLASSES - 1) == SLAB_MAX_OBJECT, "size classes must end at SLAB_MAX_OBJECT");
+
+// Header of a slab, its objects follow it
+struct Slab {
+  struct Slab* next;
+};
+
+// Header written over a free object
+struct FreeObject {
+  struct FreeObject* next;
+};
+
+struct SizeClass {
+  struct FreeObject* free_list;  // Objects free for any thread
+  struct Slab* slabs;            // Every slab of the class, only walked by slab_terminate
+};
+
+struct ThreadCache {
+  struct FreeObject* head;  // Objects free for the owner thread only
+  size_t count;             // Number of objects in head
+};
+
+// Keeps the objects after the header as aligned as anything malloc returns
+#define SLAB_HEADER ((sizeof(struct Slab) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+static struct SizeClass classes[NUM_CLASSES];
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local struct ThreadCache caches[NUM_CLASSES];
+
+/// Gets the class serving a size.
+/// @param size Bytes needed, at most SLAB_MAX_OBJECT.
+/// @return Index of the smallest class that fits size.
+static size_t class_of(size_t size) {
+  size_t class = 0;
+  while (((size_t)MIN_OBJECT << class) < size) {
+    class++;
+  }
+  return class;
+}
+
+/// Carves a new slab into free objects of a class.
+/// @note Must be called with slab_mutex held.
+/// @param class Class to grow.
+/// @return 0 if the slab was allocated successfully, 1 otherwise.
+static int grow_class(size_t class) {
+  size_t object_size = (size_t)MIN_OBJECT << class;
+  size_t num_objects = SLAB_SIZE / object_size < 4 ? 4 : SLAB_SIZE / object_size;
+
+  struct Slab* slab = malloc(SLAB_HEADER + num_objects * object_size);
+  if (slab == NULL) return 1;
+  slab->next = classes[class].slabs;
+  classes[class].slabs = slab;
+
+  char* objects = (char*)slab + SLAB_HEADER;
+  for (size_t i = num_objects; i > 0; i--) {
+    struct FreeObject* object = (struct FreeObject*)(void*)(objects + (i - 1) * object_size);
+    object->next = classes[class].free_list;
+    classes[class].free_list = object;
+  }
+  return 0;
+}
+
+void* slab_alloc(size_t size) {
+  if (size > SLAB_MAX_OBJECT) return malloc(size);
+
+  size_t class = class_of(size);
+  struct ThreadCache* cache = &caches[class];
+  if (cache->head == NULL) {
+    pthread_mutex_lock(&slab_mutex);
+    for (size_t i = 0; i < SLAB_CACHE_BATCH; i++) {
+      if (classes[class].free_list == NULL && grow_class(class) != 0) break;
+      struct FreeObject* object = classes[class].free_list;
+      classes[class].free_list = object->next;
+      object->next = cache->head;
+      cache->head = object;
+      cache->count++;
+    }
+    pthread_mutex_unlock(&slab_mutex);
+    if (cache->head == NULL) return NULL;
+  }
+
+  struct FreeObject* object = cache->head;
+  cache->head = object->next;
+  cache->count--;
+  return object;
+}
+
+void* slab_zalloc(size_t size) {
+  if (size > SLAB_MAX_OBJECT) return calloc(1, size);
+
+  void* ptr = slab_alloc(size);
+  if (ptr != NULL) memset(ptr, 0, size);
+  return ptr;
+}
+
+void slab_free(void* ptr, size_t size) {
+  if (ptr == NULL) return;
+  if (size > SLAB_MAX_OBJECT) {
+    free(ptr);
+    return;
+  }
+
+  size_t class = class_of(size);
+  struct ThreadCache* cache = &caches[class];
+  struct FreeObject* object = ptr;
+  object->next = cache->head;
+  cache->head = object;
+  if (++cache->count < 2 * SLAB_CACHE_BATCH) return;
+
+  // Threads that mostly free, like the one reclaiming retired memory, hand the surplus back to everyone
+  struct FreeObject* last = cache->head;
+  for (size_t i = 1; i < SLAB_CACHE_BATCH; i++) {
+    last = last->next;
+  }
+  struct FreeObject* batch = cache->head;
+  cache->head = last->next;
+  cache->count -= SLAB_CACHE_BATCH;
+
+  pthread_mutex_lock(&slab_mutex);
+  last->next = classes[class].free_list;
+  classes[class].free_list = batch;
+  pthread_mutex_unlock(&slab_mutex);
+}
+
+void slab_terminate() {
+  pthread_mutex_lock(&slab_mutex);
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    struct Slab* slab = classes[i].slabs;
+    while (slab) {
+      struct Slab* next = slab->next;
+      free(slab);
+      slab = next;
+    }
+    classes[i].slabs = NULL;
+    classes[i].free_list = NULL;
+  }
+  pthread_mutex_unlock(&slab_mutex);
+
+  memset(caches, 0, sizeof(caches));
+}
+
+#ifdef ALLOC_COUNT
+static _Thread_local size_t* thread_mallocs = NULL;  // Counter the calling thread adds to, if any
+
+// Provided by the linker for every function wrapped with -Wl,--wrap
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+char* __real_strdup(const char* str);
+
+void* __wrap_malloc(size_t size) {
+  if (thread_mallocs != NULL) (*thread_mallocs)++;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  if (thread_mallocs != NULL) (*thread_mallocs)++;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  if (thread_mallocs != NULL) (*thread_mallocs)++;
+  return __real_realloc(ptr, size);
+}
+
+char* __wrap_strdup(const char* str) {
+  if (thread_mallocs != NULL) (*thread_mallocs)++;
+  return __real_strdup(str);
+}
+
+void slab_count_mallocs(size_t* counter) { thread_mallocs = counter; }
+#endif
@@ -0,0 +1,40 @@
+#ifndef SERVER_SLAB_H
+#define SERVER_SLAB_H
+
+#include <stddef.h>
+
+/// Slab allocator for the objects the server creates and frees while serving requests.
+/// Sizes are rounded up to a power of two class, each class carves its objects out of large slabs that are
+/// never given back to malloc, so once the server has warmed up it serves requests without calling malloc.
+/// Every thread keeps a small cache of free objects per class and only takes the shared lock to move a
+/// batch of SLAB_CACHE_BATCH objects in or out of it.
+
+/// Allocates an object.
+/// @note Objects larger than SLAB_MAX_OBJECT are allocated with malloc.
+/// @param size Bytes needed.
+/// @return Uninitialized object of at least size bytes, NULL on failure.
+void* slab_alloc(size_t size);
+
+/// Allocates an object with every byte set to 0.
+/// @note Objects larger than SLAB_MAX_OBJECT are allocated with calloc, so their pages stay untouched until used.
+/// @param size Bytes needed.
+/// @return Zeroed object of at least size bytes, NULL on failure.
+void* slab_zalloc(size_t size);
+
+/// Frees an object allocated with slab_alloc or slab_zalloc.
+/// @param ptr Object to be freed, may be NULL.
+/// @param size Size the object was allocated with.
+void slab_free(void* ptr, size_t size);
+
+/// Gives every slab back to malloc.
+/// @note Must only be called once no other thread allocates or frees objects.
+void slab_terminate();
+
+#ifdef ALLOC_COUNT
+/// Adds every malloc, calloc, realloc and strdup call the calling thread makes from now on to a counter.
+/// @note Only available in builds made with ALLOC_COUNT=1, which wraps those functions at link time.
+/// @param counter Counter to add to, NULL to stop counting.
+void slab_count_mallocs(size_t* counter);
+#endif
+
+#endif  // SERVER_SLAB_H
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "server/eventlist.h"
+#include "server/occupancy.h"
+
+// Checks occupancy_count_free and occupancy_row_full against a plain array of reservation ids, on shapes that
+// leave partial vectors and partial words at the end of the bitmap, as seats are reserved in a random order.
+
+/// Generates the next pseudo-random number of a sequence, the same on every run.
+/// @param state State of the sequence, not 0.
+/// @return Next number.
+static unsigned int next_random(unsigned int* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/// Reserves every seat of an event in a random order, checking the queries after each reservation.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @return 0 if every check passed, 1 otherwise.
+static int check_shape(size_t rows, size_t cols) {
+  struct Event event = {.rows = rows, .cols = cols};
+  void* storage = calloc(1, occupancy_size(rows, cols));
+  unsigned int* ids = calloc(rows * cols, sizeof(unsigned int));
+  size_t* order = malloc(rows * cols * sizeof(size_t));
+  if (storage == NULL || ids == NULL || order == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+  occupancy_init(&event, storage);
+
+  unsigned int state = 2463534242u;
+  for (size_t i = 0; i < rows * cols; i++) {
+    order[i] = i;
+  }
+  for (size_t i = rows * cols; i > 1; i--) {
+    size_t j = next_random(&state) % i;
+    size_t seat = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = seat;
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i <= rows * cols && !failed; i++) {
+    size_t expected_free = 0;
+    for (size_t k = 0; k < rows * cols; k++) {
+      expected_free += ids[k] == 0;
+    }
+    if (occupancy_count_free(&event) != expected_free) {
+      fprintf(stderr, "%zux%zu: %zu free seats counted, %zu expected\n", rows, cols, occupancy_count_free(&event),
+              expected_free);
+      failed = 1;
+    }
+
+    for (size_t row = 1; row <= rows && !failed; row++) {
+      int expected_full = 1;
+      for (size_t col = 1; col <= cols; col++) {
+        expected_full &= ids[(row - 1) * cols + col - 1] != 0;
+      }
+      if (occupancy_row_full(&event, row) != expected_full) {
+        fprintf(stderr, "%zux%zu: row %zu reported %s\n", rows, cols, row, expected_full ? "free" : "full");
+        failed = 1;
+      }
+    }
+
+    if (i < rows * cols) {
+      size_t row = order[i] / cols + 1, col = order[i] % cols + 1;
+      ids[order[i]] = (unsigned int)i + 1;
+      occupancy_set(&event, row, col);
+      occupancy_update_row(&event, row);
+    }
+  }
+
+  free(order);
+  free(ids);
+  free(storage);
+  return failed;
+}
+
+int main() {
+  const size_t shapes[][2] = {{1, 1}, {3, 63}, {2, 64}, {5, 65}, {4, 130}, {7, 257}, {16, 16}, {1, 1000}};
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    failed |= check_shape(shapes[i][0], shapes[i][1]);
+  }
+  printf("occupancy: %s\n", failed ? "FAILED" : "OK");
+  return failed;
+}